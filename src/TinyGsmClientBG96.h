@@ -17,6 +17,8 @@
 #endif
 
 #define TINY_GSM_MUX_COUNT 12
+#define TINY_GSM_MODEM_HAS_READ_AHEAD
+#define TINY_GSM_MODEM_READ_CHUNK 1500  // Most one +QIRD returns
 
 #include <TinyGsmCommon.h>
 
@@ -63,9 +65,10 @@ public:
     this->at = modem;
     this->mux = mux;
     sock_available = 0;
-    prev_check = 0;
+    poll_check.reset();
     sock_connected = false;
     got_data = false;
+    connect_state = CONNECT_IDLE;
 
     at->sockets[mux] = this;
 
@@ -83,6 +86,19 @@ public:
 
 TINY_GSM_CLIENT_CONNECT_OVERLOADS()
 
+  // Starts connecting and returns right away, see poll()
+  virtual bool connectAsync(const char *host, uint16_t port, int timeout_s = 75) {
+    stop();
+    TINY_GSM_YIELD();
+    rx.clear();
+    connect_started = millis();
+    connect_timeout_ms = (uint32_t)timeout_s * 1000;
+    connect_state = at->modemConnectStart(host, port, mux) ? CONNECT_PENDING : CONNECT_FAILED;
+    return connect_state == CONNECT_PENDING;
+  }
+
+TINY_GSM_CLIENT_CONNECT_ASYNC()
+
   virtual void stop(uint32_t maxWaitMs) {
     TINY_GSM_CLIENT_DUMP_MODEM_BUFFER()
     at->sendAT(GF("+QICLOSE="), mux);
@@ -98,7 +114,7 @@ TINY_GSM_CLIENT_AVAILABLE_WITH_BUFFER_CHECK()
 
 TINY_GSM_CLIENT_READ_WITH_BUFFER_CHECK()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -110,10 +126,16 @@ private:
   TinyGsmBG96*    at;
   uint8_t         mux;
   uint16_t        sock_available;
-  uint32_t        prev_check;
+  TinyGsmPollScheduler poll_check;
   bool            sock_connected;
   bool            got_data;
+  uint8_t         connect_state;
+  uint32_t        connect_started;
+  uint32_t        connect_timeout_ms;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -143,6 +165,7 @@ public:
 
   TinyGsmBG96(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -176,10 +199,16 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_CHECK_SOCKS()
 
+TINY_GSM_MODEM_RECONCILE_SOCKS_BATCHED()
+
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {
     sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write
     waitResponse();
@@ -245,9 +274,8 @@ TINY_GSM_MODEM_SIM_UNLOCK_CPIN()
     if (waitResponse(GF(GSM_NL "+QCCID:")) != 1) {
       return "";
     }
-    String res = stream.readStringUntil('\n');
+    String res = streamGetStringBefore('\n');
     waitResponse();
-    res.trim();
     return res;
   }
 
@@ -302,7 +330,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
       return false;
     }
 
-    //Activate GPRS/CSD Context
+    //Activate GPRS/CSD Context, on its own once the context is configured
     sendAT(GF("+QIACT=1"));
     if (waitResponse(150000L) != 1) {
       return false;
@@ -333,8 +361,8 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
 
   String getLocalIP() {
     sendAT(GF("+QILOCIP"));
-    stream.readStringUntil('\n');
-    String res = stream.readStringUntil('\n');
+    streamSkipUntil('\n');
+    String res = streamGetStringBefore('\n');
     if (waitResponse() != 1) {
       return "";
     }
@@ -444,7 +472,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
     streamSkipUntil(','); // Skip battery charge status
     streamSkipUntil(','); // Skip battery charge level
     // return voltage in mV
-    uint16_t res = stream.readStringUntil(',').toInt();
+    uint16_t res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -457,7 +485,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
     }
     streamSkipUntil(','); // Skip battery charge status
     // Read battery charge level
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -469,7 +497,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
       return false;
     }
     // Read battery charge status
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -480,9 +508,9 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
     if (waitResponse(GF(GSM_NL "+CBC:")) != 1) {
       return false;
     }
-    chargeState = stream.readStringUntil(',').toInt();
-    percent = stream.readStringUntil(',').toInt();
-    milliVolts = stream.readStringUntil('\n').toInt();
+    chargeState = streamGetIntBefore(',');
+    percent = streamGetIntBefore(',');
+    milliVolts = streamGetIntBefore('\n');
     // Wait for final OK
     waitResponse();
     return true;
@@ -511,15 +539,23 @@ protected:
       return false;
     }
 
-    if (stream.readStringUntil(',').toInt() != mux) {
+    if (streamGetIntBefore(',') != mux) {
       return false;
     }
     // Read status
-    rsp = stream.readStringUntil('\n').toInt();
+    rsp = streamGetIntBefore('\n');
 
     return (0 == rsp);
   }
 
+  // Sends the connect command and leaves the result, +QIOPEN: <mux>,<err>,
+  // to be picked up by waitResponse()
+  bool modemConnectStart(const char* host, uint16_t port, uint8_t mux)
+  {
+    sendAT(GF("+QIOPEN=1,"), mux, ',', GF("\"TCP"), GF("\",\""), host, GF("\","), port, GF(",0,0"));
+    return waitResponse() == 1;
+  }
+
   int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
     sendAT(GF("+QISEND="), mux, ',', len);
     if (waitResponse(GF(">")) != 1) {
@@ -534,56 +570,78 @@ protected:
     return len;
   }
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  size_t modemRead(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    modemReadAsk(size, mux);
+    return modemReadAnswer(size, mux, dst);
+  }
+
+  void modemReadAsk(size_t size, uint8_t mux) {
     sendAT(GF("+QIRD="), mux, ',', size);
+  }
+
+  size_t modemReadAnswer(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    TINY_GSM_PROFILE(modemRead);
     if (waitResponse(GF("+QIRD:")) != 1) {
       return 0;
     }
-    size_t len = stream.readStringUntil('\n').toInt();
+    size_t len = streamGetIntBefore('\n');
 
-    for (size_t i=0; i<len; i++) {
-      TINY_GSM_MODEM_STREAM_TO_MUX_FIFO_WITH_DOUBLE_TIMEOUT
-    }
+    size_t got = streamReadToFifo(sockets[mux]->rx, len, sockets[mux]->_timeout, dst);
+    if (dst) len = got;  // Only what came in is in the caller's buffer
+    // What +QIRD=<mux>,0 last said is there, less what's been read
+    modemReadDone(sockets[mux], len, size);
     waitResponse();
     DBG("### READ:", len, "from", mux);
-    sockets[mux]->sock_available = modemGetAvailable(mux);
     return len;
   }
 
+TINY_GSM_MODEM_READ_DONE()
+
+TINY_GSM_MODEM_READ_AHEAD()
+
   size_t modemGetAvailable(uint8_t mux) {
     sendAT(GF("+QIRD="), mux, GF(",0"));
     size_t result = 0;
     if (waitResponse(GF("+QIRD:")) == 1) {
       streamSkipUntil(','); // Skip total received
       streamSkipUntil(','); // Skip have read
-      result = stream.readStringUntil('\n').toInt();
+      result = streamGetIntBefore('\n');
       if (result) DBG("### DATA AVAILABLE:", result, "on", mux);
       waitResponse();
     }
-    if (!result) {
-      sockets[mux]->sock_connected = modemGetConnected(mux);
-    }
     return result;
   }
 
+  // Updates the state of all sockets; the modem lists every open connection
   bool modemGetConnected(uint8_t mux) {
-    sendAT(GF("+QISTATE=1,"), mux);
+    sendAT(GF("+QISTATE?"));
     //+QISTATE: 0,"TCP","151.139.237.11",80,5087,4,1,0,0,"uart1"
-
-    if (waitResponse(GF("+QISTATE:")))
-      return false;
-
-    streamSkipUntil(','); // Skip mux
-    streamSkipUntil(','); // Skip socket type
-    streamSkipUntil(','); // Skip remote ip
-    streamSkipUntil(','); // Skip remote port
-    streamSkipUntil(','); // Skip local port
-    int res = stream.readStringUntil(',').toInt(); // socket state
-
-    waitResponse();
-
-    // 0 Initial, 1 Opening, 2 Connected, 3 Listening, 4 Closing
-    return 2 == res;
+    uint16_t connected = 0;
+    for (;;) {
+      int8_t res = waitResponse(GFP(GSM_OK), GF(GSM_NL "+QISTATE:"), GFP(GSM_ERROR));
+      if (res == 1) {
+        break;
+      } else if (res != 2) {
+        return false;  // ERROR, or no answer
+      }
+      int muxNo = streamGetIntBefore(',');
+      streamSkipUntil(','); // Skip socket type
+      streamSkipUntil(','); // Skip remote ip
+      streamSkipUntil(','); // Skip remote port
+      streamSkipUntil(','); // Skip local port
+      int state = streamGetIntBefore(','); // socket state
+      // 0 Initial, 1 Opening, 2 Connected, 3 Listening, 4 Closing
+      if (2 == state && muxNo >= 0 && muxNo < TINY_GSM_MUX_COUNT) {
+        connected |= 1 << muxNo;
+      }
+    }
+    // Sockets that aren't listed are closed
+    for (int muxNo = 0; muxNo < TINY_GSM_MUX_COUNT; muxNo++) {
+      if (sockets[muxNo]) {
+        sockets[muxNo]->sock_connected = connected & (1 << muxNo);
+      }
+    }
+    return connected & (1 << mux);
   }
 
 public:
@@ -594,18 +652,27 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
+    TINY_GSM_READ_AHEAD_SETTLE(*this);  // Its answer comes first
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<7> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcQiurc = match.add(GF(GSM_NL "+QIURC:"));
+    const uint8_t urcQiopen = match.add(GF(GSM_NL "+QIOPEN:"));
     int index = 0;
     unsigned long startMillis = millis();
     do {
@@ -614,64 +681,71 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
           goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+QIURC:"))) {
-          stream.readStringUntil('\"');
-          String urc = stream.readStringUntil('\"');
-          stream.readStringUntil(',');
-          if (urc == "recv") {
-            int mux = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcQiurc) {
+          streamSkipUntil('\"');
+          char urc[16];
+          urc[stream.readBytesUntil('\"', urc, sizeof(urc) - 1)] = '\0';
+          streamSkipUntil(',');
+          if (!strcmp(urc, "recv")) {
+            int mux = streamGetIntBefore('\n');
             DBG("### URC RECV:", mux);
             if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
               sockets[mux]->got_data = true;
             }
-          } else if (urc == "closed") {
-            int mux = stream.readStringUntil('\n').toInt();
+          } else if (!strcmp(urc, "closed")) {
+            int mux = streamGetIntBefore('\n');
             DBG("### URC CLOSE:", mux);
             if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
               sockets[mux]->sock_connected = false;
             }
           } else {
-            stream.readStringUntil('\n');
+            streamSkipUntil('\n');
           }
-          data = "";
+          response.clear();
+          match.reset();
+        } else if (hit == urcQiopen) {
+          int mux = streamGetIntBefore(',');
+          int err = streamGetIntBefore('\n');
+          if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux] &&
+              sockets[mux]->connect_state == CONNECT_PENDING) {
+            sockets[mux]->sock_connected = (0 == err);
+            sockets[mux]->connect_state = (0 == err) ? CONNECT_DONE : CONNECT_FAILED;
+          }
+          response.clear();
+          match.reset();
+          DBG("### URC OPEN:", mux, err);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    TINY_GSM_READ_AHEAD_SETTLE(*this);  // Not into data
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -685,6 +759,14 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
+  TinyGsmInterval reconcile;
+#if TINY_GSM_READ_AHEAD
+  TinyGsmReadAhead ahead;
+#endif
 };
 
 #endif
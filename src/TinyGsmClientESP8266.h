@@ -17,6 +17,7 @@
 #endif
 
 #define TINY_GSM_MUX_COUNT 5
+#define TINY_GSM_MODEM_PUSHES_DATA
 
 #include <TinyGsmCommon.h>
 
@@ -82,6 +83,9 @@ TINY_GSM_CLIENT_CONNECT_OVERLOADS()
 
   virtual void stop(uint32_t maxWaitMs) {
     TINY_GSM_YIELD();
+    rx.clear();  // Room for data held back for it, so pending writes go out
+    sendPending(true);
+    at->dropHeld(mux);  // Whatever still doesn't fit, so the close does
     at->sendAT(GF("+CIPCLOSE="), mux);
     sock_connected = false;
     at->waitResponse(maxWaitMs);
@@ -96,7 +100,7 @@ TINY_GSM_CLIENT_AVAILABLE_NO_MODEM_FIFO()
 
 TINY_GSM_CLIENT_READ_NO_MODEM_FIFO()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -109,6 +113,9 @@ private:
   uint8_t         mux;
   bool            sock_connected;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -138,6 +145,7 @@ public:
 
   TinyGsmESP8266(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -178,13 +186,35 @@ public:
   }
 
   void setBaud(unsigned long baud) {
-    sendAT(GF("+UART_CUR="), baud, "8,1,0,0");
+    sendAT(GF("+UART_CUR="), baud, ",8,1,0,0");
   }
 
+  // Switches RTS/CTS flow control on or off, at the current baud rate
+  bool setFlowControl(bool hw, TinyGsmFlowControl::RtsHandler rts = NULL,
+                      void* arg = NULL) {
+    sendAT(GF("+UART_CUR?"));
+    if (waitResponse(GF(GSM_NL "+UART_CUR:")) != 1) {
+      return false;
+    }
+    uint32_t baud = streamGetIntBefore(',');
+    streamSkipUntil('\n');
+    waitResponse();
+    sendAT(GF("+UART_CUR="), baud, ",8,1,0,", hw ? 3 : 0);
+    if (waitResponse() != 1) {
+      return false;
+    }
+    flow.enable(hw, rts, arg);
+    return true;
+  }
+
+TINY_GSM_MODEM_NEGOTIATE_BAUD()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_LISTEN()
 
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {
     sendAT(GF("+RESTORE"));
     return waitResponse() == 1;
@@ -324,7 +354,7 @@ TINY_GSM_MODEM_MAINTAIN_LISTEN()
     if (res1 != 2) {
       return "";
     }
-    String res2 = stream.readStringUntil('"');
+    String res2 = streamGetStringBefore('"');
     waitResponse();
     return res2;
   }
@@ -395,89 +425,87 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+TINY_GSM_MODEM_PUSH_TO_SOCKET()
+
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<7> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcIpd = match.add(GF("+IPD,"));
+    const uint8_t urcClosed = match.add(GF("CLOSED"));
     int index = 0;
     unsigned long startMillis = millis();
     do {
       TINY_GSM_YIELD();
+      if (flow.holding() && !pushToSocket(flow.mux, flow.left, false)) {
+        goto finish;  // Still no room, so the command wasn't sent either
+      }
       while (stream.available() > 0) {
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
           goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (data.endsWith(GF("+IPD,"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          int len = stream.readStringUntil(':').toInt();
-          int len_orig = len;
-          if (len > sockets[mux]->rx.free()) {
-            DBG("### Buffer overflow: ", len, "received vs", sockets[mux]->rx.free(), "available");
-          } else {
-            DBG("### Got Data: ", len, "on", mux);
-          }
-          while (len--) {
-            TINY_GSM_MODEM_STREAM_TO_MUX_FIFO_WITH_DOUBLE_TIMEOUT
-          }
-          if (len_orig > sockets[mux]->available()) { // TODO
-            DBG("### Fewer characters received than expected: ", sockets[mux]->available(), " vs ", len_orig);
+        } else if (hit == urcIpd) {
+          int mux = streamGetIntBefore(',');
+          int len = streamGetIntBefore(':');
+          DBG("### Got Data: ", len, "on", mux);
+          response.clear();
+          match.reset();
+          if (len > 0 && !pushToSocket(mux, len, r1 != NULL)) {
+            goto finish;  // No room, the rest waits in the UART
           }
-          data = "";
-        } else if (data.endsWith(GF("CLOSED"))) {
-          int muxStart = max(0,data.lastIndexOf(GSM_NL, data.length()-8));
-          int coma = data.indexOf(',', muxStart);
-          int mux = data.substring(muxStart, coma).toInt();
+        } else if (hit == urcClosed) {
+          int mux = atoi(response.lineStart(6));
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Closed: ", mux);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -491,6 +519,10 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
 };
 
 #endif
@@ -17,6 +17,7 @@
 #endif
 
 #define TINY_GSM_MUX_COUNT 2
+#define TINY_GSM_MODEM_PUSHES_DATA
 
 #include <TinyGsmCommon.h>
 
@@ -83,6 +84,9 @@ TINY_GSM_CLIENT_CONNECT_OVERLOADS()
 
   virtual void stop(uint32_t maxWaitMs) {
     TINY_GSM_YIELD();
+    rx.clear();  // Room for data held back for it, so pending writes go out
+    sendPending(true);
+    at->dropHeld(mux);  // Whatever still doesn't fit, so the close does
     at->sendAT(GF("+TCPCLOSE="), mux);
     sock_connected = false;
     at->waitResponse(maxWaitMs);
@@ -97,7 +101,7 @@ TINY_GSM_CLIENT_AVAILABLE_NO_MODEM_FIFO()
 
 TINY_GSM_CLIENT_READ_NO_MODEM_FIFO()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -110,6 +114,9 @@ private:
   uint8_t         mux;
   bool            sock_connected;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -117,6 +124,7 @@ public:
 
   TinyGsmM590(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -155,10 +163,14 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_LISTEN()
 
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {
     sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write
     waitResponse();
@@ -313,7 +325,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+XIIC:")) != 1) {
       return false;
     }
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     waitResponse();
     return res == 1;
   }
@@ -327,10 +339,9 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+XIIC:")) != 1) {
       return "";
     }
-    stream.readStringUntil(',');
-    String res = stream.readStringUntil('\n');
+    streamGetStringBefore(',');
+    String res = streamGetStringBefore('\n');
     waitResponse();
-    res.trim();
     return res;
   }
 
@@ -366,7 +377,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     stream.readStringUntil('"');
     String hex = stream.readStringUntil('"');
     stream.readStringUntil(',');
-    int dcs = stream.readStringUntil('\n').toInt();
+    int dcs = streamGetIntBefore('\n');
 
     if (waitResponse() != 1) {
       return "";
@@ -483,88 +494,88 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+TINY_GSM_MODEM_PUSH_TO_SOCKET()
+
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<7> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcRecv = match.add(GF("+TCPRECV:"));
+    const uint8_t urcClosed = match.add(GF("+TCPCLOSE:"));
     int index = 0;
     unsigned long startMillis = millis();
     do {
       TINY_GSM_YIELD();
+      if (flow.holding() && !pushToSocket(flow.mux, flow.left, false)) {
+        goto finish;  // Still no room, so the command wasn't sent either
+      }
       while (stream.available() > 0) {
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
           goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (data.endsWith(GF("+TCPRECV:"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          int len = stream.readStringUntil(',').toInt();
-          int len_orig = len;
-          if (len > sockets[mux]->rx.free()) {
-            DBG("### Buffer overflow: ", len, "->", sockets[mux]->rx.free());
-          } else {
-            DBG("### Got: ", len, "->", sockets[mux]->rx.free());
-          }
-          while (len--) {
-            TINY_GSM_MODEM_STREAM_TO_MUX_FIFO_WITH_DOUBLE_TIMEOUT
+        } else if (hit == urcRecv) {
+          int mux = streamGetIntBefore(',');
+          int len = streamGetIntBefore(',');
+          DBG("### Got: ", len, "on", mux);
+          response.clear();
+          match.reset();
+          if (len > 0 && !pushToSocket(mux, len, r1 != NULL)) {
+            goto finish;  // No room, the rest waits in the UART
           }
-          if (len_orig > sockets[mux]->available()) { // TODO
-            DBG("### Fewer characters received than expected: ", sockets[mux]->available(), " vs ", len_orig);
-          }
-          data = "";
-        } else if (data.endsWith(GF("+TCPCLOSE:"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          stream.readStringUntil('\n');
+        } else if (hit == urcClosed) {
+          int mux = streamGetIntBefore(',');
+          streamSkipUntil('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT) {
             sockets[mux]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Closed: ", mux);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -578,6 +589,10 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
 };
 
 #endif
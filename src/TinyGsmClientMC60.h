@@ -101,7 +101,7 @@ TINY_GSM_CLIENT_AVAILABLE_NO_BUFFER_CHECK()
 
 TINY_GSM_CLIENT_READ_NO_BUFFER_CHECK()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -116,6 +116,9 @@ private:
   bool            sock_connected;
   bool            got_data;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -145,6 +148,7 @@ public:
 
   TinyGsmMC60(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -186,10 +190,14 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_LISTEN()
 
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {
     sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write
     waitResponse();
@@ -389,9 +397,8 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
 
   String getLocalIP() {
     sendAT(GF("+QILOCIP"));
-    stream.readStringUntil('\n');
-    String res = stream.readStringUntil('\n');
-    res.trim();
+    streamSkipUntil('\n');
+    String res = streamGetStringBefore('\n');
     return res;
   }
 
@@ -415,7 +422,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
     stream.readStringUntil('"');
     String hex = stream.readStringUntil('"');
     stream.readStringUntil(',');
-    int dcs = stream.readStringUntil('\n').toInt();
+    int dcs = streamGetIntBefore('\n');
 
     if (waitResponse() != 1) {
       return "";
@@ -510,7 +517,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
     streamSkipUntil(','); // Skip battery charge status
     streamSkipUntil(','); // Skip battery charge level
     // return voltage in mV
-    uint16_t res = stream.readStringUntil(',').toInt();
+    uint16_t res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -523,7 +530,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
     }
     streamSkipUntil(','); // Skip battery charge status
     // Read battery charge level
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -535,7 +542,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
       return false;
     }
     // Read battery charge status
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -546,9 +553,9 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
     if (waitResponse(GF(GSM_NL "+CBC:")) != 1) {
       return false;
     }
-    chargeState = stream.readStringUntil(',').toInt();
-    percent = stream.readStringUntil(',').toInt();
-    milliVolts = stream.readStringUntil('\n').toInt();
+    chargeState = streamGetIntBefore(',');
+    percent = streamGetIntBefore(',');
+    milliVolts = streamGetIntBefore('\n');
     // Wait for final OK
     waitResponse();
     return true;
@@ -594,7 +601,7 @@ protected:
       } else {
         streamSkipUntil(','); /** Skip total */
         streamSkipUntil(','); /** Skip acknowledged data size */
-        if ( stream.readStringUntil('\n').toInt() == 0 ) {
+        if ( streamGetIntBefore('\n') == 0 ) {
           allAcknowledged = true;
         }
       }
@@ -602,12 +609,13 @@ protected:
     waitResponse(5000L);
 
     // streamSkipUntil(','); // Skip mux
-    // return stream.readStringUntil('\n').toInt();
+    // return streamGetIntBefore('\n');
 
     return len;  // TODO
   }
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  size_t modemRead(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    TINY_GSM_PROFILE(modemRead);
     // TODO:  Does this work????
     // AT+QIRD=<id>,<sc>,<sid>,<len>
     // id = GPRS context number - 0, set in GPRS connect
@@ -622,12 +630,11 @@ protected:
     streamSkipUntil(':');  // skip IP address
     streamSkipUntil(',');  // skip port
     streamSkipUntil(',');  // skip connection type (TCP/UDP)
-    size_t len = stream.readStringUntil('\n').toInt();  // read length
-    for (size_t i=0; i<len; i++) {
-      TINY_GSM_MODEM_STREAM_TO_MUX_FIFO_WITH_DOUBLE_TIMEOUT
-      sockets[mux]->sock_available--;
-      // ^^ One less character available after moving from modem's FIFO to our FIFO
-    }
+    size_t len = streamGetIntBefore('\n');  // read length
+    size_t got = streamReadToFifo(sockets[mux]->rx, len, sockets[mux]->_timeout, dst);
+    if (dst) len = got;  // Only what came in is in the caller's buffer
+    sockets[mux]->sock_available -= len;
+    // ^^ That many characters less available after moving from modem's FIFO to our FIFO
     waitResponse();
     DBG("### READ:", len, "from", mux);
     return len;
@@ -645,7 +652,7 @@ protected:
     streamSkipUntil(','); // Skip remote ip
     streamSkipUntil(','); // Skip remote port
     streamSkipUntil(','); // Skip local port
-    int res = stream.readStringUntil(',').toInt(); // socket state
+    int res = streamGetIntBefore(','); // socket state
 
     waitResponse();
 
@@ -661,11 +668,11 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL, GsmConstStr r6=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
@@ -673,7 +680,16 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
     String r5s(r5); r5s.trim();
     String r6s(r6); r6s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s, ",", r6s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<8> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    match.add(r6);
+    const uint8_t urcQird = match.add(GF(GSM_NL "+QIRD:"));
+    const uint8_t urcClosed = match.add(GF("CLOSED" GSM_NL));
     int index = 0;
     unsigned long startMillis = millis();
     do {
@@ -682,64 +698,53 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 6) {
+          index = hit;
           goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (r6 && data.endsWith(r6)) {
-          index = 6;
-          goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+QIRD:"))) {  // TODO:  QIRD? or QIRDI?
+        } else if (hit == urcQird) {  // TODO:  QIRD? or QIRDI?
           streamSkipUntil(',');  // Skip the context
           streamSkipUntil(',');  // Skip the role
-          int mux = stream.readStringUntil('\n').toInt();
+          int mux = streamGetIntBefore('\n');
           DBG("### Got Data:", mux);
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
             sockets[mux]->got_data = true;
           }
-        } else if (data.endsWith(GF("CLOSED" GSM_NL))) {
-          int nl = data.lastIndexOf(GSM_NL, data.length()-8);
-          int coma = data.indexOf(',', nl+2);
-          int mux = data.substring(nl+2, coma).toInt();
+        } else if (hit == urcClosed) {
+          int mux = atoi(response.lineStart(8));
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Closed: ", mux);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL, GsmConstStr r6=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5, r6);
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5, r6);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -753,6 +758,10 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
 };
 
 #endif
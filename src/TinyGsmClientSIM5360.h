@@ -68,7 +68,7 @@ public:
     this->at = modem;
     this->mux = mux;
     sock_available = 0;
-    prev_check = 0;
+    poll_check.reset();
     sock_connected = false;
     got_data = false;
 
@@ -103,7 +103,7 @@ TINY_GSM_CLIENT_AVAILABLE_WITH_BUFFER_CHECK()
 
 TINY_GSM_CLIENT_READ_WITH_BUFFER_CHECK()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -115,10 +115,13 @@ private:
   TinyGsmSim5360* at;
   uint8_t         mux;
   uint16_t        sock_available;
-  uint32_t        prev_check;
+  TinyGsmPollScheduler poll_check;
   bool            sock_connected;
   bool            got_data;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -126,6 +129,7 @@ public:
 
   TinyGsmSim5360(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -173,10 +177,16 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_CHECK_SOCKS()
 
+TINY_GSM_MODEM_RECONCILE_SOCKS()
+
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {  // these commands aren't supported
     return false;
   }
@@ -242,9 +252,8 @@ TINY_GSM_MODEM_SIM_UNLOCK_CPIN()
     if (waitResponse(GF(GSM_NL "+ICCID:")) != 1) {
       return "";
     }
-    String res = stream.readStringUntil('\n');
+    String res = streamGetStringBefore('\n');
     waitResponse();
-    res.trim();
     return res;
   }
 
@@ -451,14 +460,10 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
   String getLocalIP() {
     sendAT(GF("+IPADDR"));  // Inquire Socket PDP address
     // sendAT(GF("+CGPADDR=1"));  // Show PDP address
-    String res;
-    if (waitResponse(10000L, res) != 1) {
+    if (waitResponse(10000L) != 1) {
       return "";
     }
-    res.replace(GSM_NL "OK" GSM_NL, "");
-    res.replace(GSM_NL, "");
-    res.trim();
-    return res;
+    return responseBody();
   }
 
   IPAddress localIP() {
@@ -494,7 +499,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     stream.readStringUntil('"');
     String hex = stream.readStringUntil('"');
     stream.readStringUntil(',');
-    int dcs = stream.readStringUntil('\n').toInt();
+    int dcs = streamGetIntBefore('\n');
 
     if (dcs == 15) {
       return TinyGsmDecodeHex8bit(hex);
@@ -579,7 +584,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     streamSkipUntil(','); // Skip battery charge status
     streamSkipUntil(','); // Skip battery charge level
     // return voltage in mV
-    uint16_t res = stream.readStringUntil(',').toInt();
+    uint16_t res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -592,7 +597,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     }
     streamSkipUntil(','); // Skip battery charge status
     // Read battery charge level
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -604,7 +609,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
       return false;
     }
     // Read battery charge status
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -615,9 +620,9 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+CBC:")) != 1) {
       return false;
     }
-    chargeState = stream.readStringUntil(',').toInt();
-    percent = stream.readStringUntil(',').toInt();
-    milliVolts = stream.readStringUntil('\n').toInt();
+    chargeState = streamGetIntBefore(',');
+    percent = streamGetIntBefore(',');
+    milliVolts = streamGetIntBefore('\n');
     // Wait for final OK
     waitResponse();
     return true;
@@ -661,10 +666,11 @@ protected:
     streamSkipUntil(','); // Skip mux
     streamSkipUntil(','); // Skip requested bytes to send
     // TODO:  make sure requested and confirmed bytes match
-    return stream.readStringUntil('\n').toInt();
+    return streamGetIntBefore('\n');
   }
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  size_t modemRead(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    TINY_GSM_PROFILE(modemRead);
 #ifdef TINY_GSM_USE_HEX
     sendAT(GF("+CIPRXGET=3,"), mux, ',', size);
     if (waitResponse(GF("+CIPRXGET:")) != 1) {
@@ -678,24 +684,16 @@ protected:
 #endif
     streamSkipUntil(','); // Skip Rx mode 2/normal or 3/HEX
     streamSkipUntil(','); // Skip mux/cid (connecion id)
-    size_t len_requested = stream.readStringUntil(',').toInt();
+    size_t len_requested = streamGetIntBefore(',');
     //  ^^ Requested number of data bytes (1-1460 bytes)to be read
-    size_t len_confirmed = stream.readStringUntil('\n').toInt();
+    size_t len_confirmed = streamGetIntBefore('\n');
     // ^^ The data length which not read in the buffer
-    for (size_t i=0; i<len_requested; i++) {
-      uint32_t startMillis = millis();
 #ifdef TINY_GSM_USE_HEX
-      while (stream.available() < 2 && (millis() - startMillis < sockets[mux]->_timeout)) { TINY_GSM_YIELD(); }
-      char buf[4] = { 0, };
-      buf[0] = stream.read();
-      buf[1] = stream.read();
-      char c = strtol(buf, NULL, 16);
+    size_t got = streamReadHexToFifo(sockets[mux]->rx, len_requested, sockets[mux]->_timeout, dst);
 #else
-      while (!stream.available() && (millis() - startMillis < sockets[mux]->_timeout)) { TINY_GSM_YIELD(); }
-      char c = stream.read();
+    size_t got = streamReadToFifo(sockets[mux]->rx, len_requested, sockets[mux]->_timeout, dst);
 #endif
-      sockets[mux]->rx.put(c);
-    }
+    if (dst) len_requested = got;  // Only what came in is in the caller's buffer
     DBG("### READ:", len_requested, "from", mux);
     // sockets[mux]->sock_available = modemGetAvailable(mux);
     sockets[mux]->sock_available = len_confirmed;
@@ -709,13 +707,10 @@ protected:
     if (waitResponse(GF("+CIPRXGET:")) == 1) {
       streamSkipUntil(','); // Skip mode 4
       streamSkipUntil(','); // Skip mux
-      result = stream.readStringUntil('\n').toInt();
+      result = streamGetIntBefore('\n');
       waitResponse();
     }
     DBG("### Available:", result, "on", mux);
-    if (!result) {
-      sockets[mux]->sock_connected = modemGetConnected(mux);
-    }
     return result;
   }
 
@@ -724,12 +719,19 @@ protected:
     sendAT(GF("+CIPCLOSE?"), mux);
     if (waitResponse(GFP(GSM_OK), GF(GSM_NL "+CIPCLOSE: ")) != 2)
       return false;
-    for (int muxNo = 0; muxNo <= TINY_GSM_MUX_COUNT; muxNo++) {
+    bool res = false;
+    for (int muxNo = 0; muxNo < TINY_GSM_MUX_COUNT; muxNo++) {
       // +CIPCLOSE:<link0_state>,<link1_state>,...,<link9_state>
-      sockets[muxNo]->sock_connected = stream.parseInt();
+      bool connected = stream.parseInt();
+      if (sockets[muxNo]) {
+        sockets[muxNo]->sock_connected = connected;
+      }
+      if (muxNo == mux) {
+        res = connected;
+      }
     }
     waitResponse();  // Should be an OK at the end
-    return sockets[mux]->sock_connected;
+    return res;
   }
 
 public:
@@ -740,18 +742,27 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<8> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcRxGet = match.add(GF(GSM_NL "+CIPRXGET:"));
+    const uint8_t urcReceive = match.add(GF(GSM_NL "+RECEIVE:"));
+    const uint8_t urcClosed = match.add(GF("+IPCLOSE:"));
     int index = 0;
     unsigned long startMillis = millis();
     do {
@@ -760,73 +771,66 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
           goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+CIPRXGET:"))) {
-          String mode = stream.readStringUntil(',');
-          if (mode.toInt() == 1) {
-            int mux = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcRxGet) {
+          int mode = streamGetIntBefore(',');
+          if (mode == 1) {
+            int mux = streamGetIntBefore('\n');
             if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
               sockets[mux]->got_data = true;
             }
-            data = "";
+            response.clear();
+            match.reset();
             DBG("### Got Data:", mux);
-          } else {
-            data += mode;
           }
-        } else if (data.endsWith(GF(GSM_NL "+RECEIVE:"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          int len = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcReceive) {
+          int mux = streamGetIntBefore(',');
+          int len = streamGetIntBefore('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->got_data = true;
-            sockets[mux]->sock_available = len;
+            sockets[mux]->sock_available = len;  // No need to ask
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Got Data:", len, "on", mux);
-        } else if (data.endsWith(GF("+IPCLOSE:"))) {
-          int mux = stream.readStringUntil(',').toInt();
+        } else if (hit == urcClosed) {
+          int mux = streamGetIntBefore(',');
           streamSkipUntil('\n');  // Skip the reason code
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Closed: ", mux);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -840,6 +844,11 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
+  TinyGsmInterval reconcile;
 };
 
 #endif
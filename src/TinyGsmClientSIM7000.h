@@ -68,9 +68,10 @@ public:
     this->at = modem;
     this->mux = mux;
     sock_available = 0;
-    prev_check = 0;
+    poll_check.reset();
     sock_connected = false;
     got_data = false;
+    connect_state = CONNECT_IDLE;
 
     at->sockets[mux] = this;
 
@@ -88,6 +89,19 @@ public:
 
 TINY_GSM_CLIENT_CONNECT_OVERLOADS()
 
+  // Starts connecting and returns right away, see poll()
+  virtual bool connectAsync(const char *host, uint16_t port, int timeout_s = 75) {
+    stop();
+    TINY_GSM_YIELD();
+    rx.clear();
+    connect_started = millis();
+    connect_timeout_ms = (uint32_t)timeout_s * 1000;
+    connect_state = at->modemConnectStart(host, port, mux) ? CONNECT_PENDING : CONNECT_FAILED;
+    return connect_state == CONNECT_PENDING;
+  }
+
+TINY_GSM_CLIENT_CONNECT_ASYNC()
+
   virtual void stop(uint32_t maxWaitMs) {
     TINY_GSM_CLIENT_DUMP_MODEM_BUFFER()
     at->sendAT(GF("+CIPCLOSE="), mux);
@@ -103,7 +117,7 @@ TINY_GSM_CLIENT_AVAILABLE_WITH_BUFFER_CHECK()
 
 TINY_GSM_CLIENT_READ_WITH_BUFFER_CHECK()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -115,10 +129,16 @@ private:
   TinyGsmSim7000* at;
   uint8_t         mux;
   uint16_t        sock_available;
-  uint32_t        prev_check;
+  TinyGsmPollScheduler poll_check;
   bool            sock_connected;
   bool            got_data;
+  uint8_t         connect_state;
+  uint32_t        connect_started;
+  uint32_t        connect_timeout_ms;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -150,6 +170,7 @@ public:
 
   TinyGsmSim7000(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -197,10 +218,16 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_CHECK_SOCKS()
 
+TINY_GSM_MODEM_RECONCILE_SOCKS()
+
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {  // these commands aren't supported
     return false;
   }
@@ -460,7 +487,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+CGATT:")) != 1) {
       return false;
     }
-    int res = stream.readStringUntil('\n').toInt();
+    int res = streamGetIntBefore('\n');
     waitResponse();
     if (res != 1)
       return false;
@@ -478,14 +505,10 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
 
   String getLocalIP() {
     sendAT(GF("+CIFSR;E0"));
-    String res;
-    if (waitResponse(10000L, res) != 1) {
+    if (waitResponse(10000L) != 1) {
       return "";
     }
-    res.replace(GSM_NL "OK" GSM_NL, "");
-    res.replace(GSM_NL, "");
-    res.trim();
-    return res;
+    return responseBody();
   }
 
   IPAddress localIP() {
@@ -521,7 +544,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     stream.readStringUntil('"');
     String hex = stream.readStringUntil('"');
     stream.readStringUntil(',');
-    int dcs = stream.readStringUntil('\n').toInt();
+    int dcs = streamGetIntBefore('\n');
 
     if (dcs == 15) {
       return TinyGsmDecodeHex8bit(hex);
@@ -639,7 +662,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     }
 
     stream.readStringUntil(','); // mode
-    if ( stream.readStringUntil(',').toInt() == 1 ) fix = true;
+    if ( streamGetIntBefore(',') == 1 ) fix = true;
     stream.readStringUntil(','); //utctime
     *lat =  stream.readStringUntil(',').toFloat(); //lat
     *lon =  stream.readStringUntil(',').toFloat(); //lon
@@ -652,8 +675,8 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     stream.readStringUntil(',');
     stream.readStringUntil(',');
     stream.readStringUntil(',');
-    if (vsat != NULL) *vsat = stream.readStringUntil(',').toInt(); //viewed satelites
-    if (usat != NULL) *usat = stream.readStringUntil(',').toInt(); //used satelites
+    if (vsat != NULL) *vsat = streamGetIntBefore(','); //viewed satelites
+    if (usat != NULL) *usat = streamGetIntBefore(','); //used satelites
     stream.readStringUntil('\n');
 
     waitResponse();
@@ -748,7 +771,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     streamSkipUntil(','); // Skip battery charge status
     streamSkipUntil(','); // Skip battery charge level
     // return voltage in mV
-    uint16_t res = stream.readStringUntil(',').toInt();
+    uint16_t res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -761,7 +784,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     }
     streamSkipUntil(','); // Skip battery charge status
     // Read battery charge level
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -773,7 +796,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
       return false;
     }
     // Read battery charge status
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -784,9 +807,9 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+CBC:")) != 1) {
       return false;
     }
-    chargeState = stream.readStringUntil(',').toInt();
-    percent = stream.readStringUntil(',').toInt();
-    milliVolts = stream.readStringUntil('\n').toInt();
+    chargeState = streamGetIntBefore(',');
+    percent = streamGetIntBefore(',');
+    milliVolts = streamGetIntBefore('\n');
     // Wait for final OK
     waitResponse();
     return true;
@@ -816,6 +839,14 @@ protected:
     return (1 == rsp);
   }
 
+  // Sends the connect command and leaves the result, "<mux>, CONNECT OK" or
+  // "<mux>, CONNECT FAIL", to be picked up by waitResponse()
+  bool modemConnectStart(const char* host, uint16_t port, uint8_t mux)
+  {
+    sendAT(GF("+CIPSTART="), mux, ',', GF("\"TCP"), GF("\",\""), host, GF("\","), port);
+    return waitResponse() == 1;
+  }
+
   int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
     sendAT(GF("+CIPSEND="), mux, ',', len);
     if (waitResponse(GF(">")) != 1) {
@@ -827,10 +858,11 @@ protected:
       return 0;
     }
     streamSkipUntil(','); // Skip mux
-    return stream.readStringUntil('\n').toInt();
+    return streamGetIntBefore('\n');
   }
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  size_t modemRead(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    TINY_GSM_PROFILE(modemRead);
 #ifdef TINY_GSM_USE_HEX
     sendAT(GF("+CIPRXGET=3,"), mux, ',', size);
     if (waitResponse(GF("+CIPRXGET:")) != 1) {
@@ -844,26 +876,18 @@ protected:
 #endif
     streamSkipUntil(','); // Skip Rx mode 2/normal or 3/HEX
     streamSkipUntil(','); // Skip mux
-    size_t len_requested = stream.readStringUntil(',').toInt();
+    size_t len_requested = streamGetIntBefore(',');
     //  ^^ Requested number of data bytes (1-1460 bytes)to be read
-    size_t len_confirmed = stream.readStringUntil('\n').toInt();
+    size_t len_confirmed = streamGetIntBefore('\n');
     // ^^ Confirmed number of data bytes to be read, which may be less than requested.
     // 0 indicates that no data can be read.
     // This is actually be the number of bytes that will be remaining after the read
-    for (size_t i=0; i<len_requested; i++) {
-      uint32_t startMillis = millis();
 #ifdef TINY_GSM_USE_HEX
-      while (stream.available() < 2 && (millis() - startMillis < sockets[mux]->_timeout)) { TINY_GSM_YIELD(); }
-      char buf[4] = { 0, };
-      buf[0] = stream.read();
-      buf[1] = stream.read();
-      char c = strtol(buf, NULL, 16);
+    size_t got = streamReadHexToFifo(sockets[mux]->rx, len_requested, sockets[mux]->_timeout, dst);
 #else
-      while (!stream.available() && (millis() - startMillis < sockets[mux]->_timeout)) { TINY_GSM_YIELD(); }
-      char c = stream.read();
+    size_t got = streamReadToFifo(sockets[mux]->rx, len_requested, sockets[mux]->_timeout, dst);
 #endif
-      sockets[mux]->rx.put(c);
-    }
+    if (dst) len_requested = got;  // Only what came in is in the caller's buffer
     DBG("### READ:", len_requested, "from", mux);
     // sockets[mux]->sock_available = modemGetAvailable(mux);
     sockets[mux]->sock_available = len_confirmed;
@@ -877,13 +901,10 @@ protected:
     if (waitResponse(GF("+CIPRXGET:")) == 1) {
       streamSkipUntil(','); // Skip mode 4
       streamSkipUntil(','); // Skip mux
-      result = stream.readStringUntil('\n').toInt();
+      result = streamGetIntBefore('\n');
       waitResponse();
     }
     DBG("### Available:", result, "on", mux);
-    if (!result) {
-      sockets[mux]->sock_connected = modemGetConnected(mux);
-    }
     return result;
   }
 
@@ -902,18 +923,29 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<10> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcRxGet = match.add(GF(GSM_NL "+CIPRXGET:"));
+    const uint8_t urcReceive = match.add(GF(GSM_NL "+RECEIVE:"));
+    const uint8_t urcClosed = match.add(GF("CLOSED" GSM_NL));
+    const uint8_t urcConnectOk = match.add(GF("CONNECT OK" GSM_NL));
+    const uint8_t urcConnectFail = match.add(GF("CONNECT FAIL" GSM_NL));
     int index = 0;
     unsigned long startMillis = millis();
     do {
@@ -922,74 +954,79 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (match.longest() == urcConnectOk || match.longest() == urcConnectFail) {
+          hit = match.longest();  // Not the "OK" of a response
+        }
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
           goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+CIPRXGET:"))) {
-          String mode = stream.readStringUntil(',');
-          if (mode.toInt() == 1) {
-            int mux = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcRxGet) {
+          int mode = streamGetIntBefore(',');
+          if (mode == 1) {
+            int mux = streamGetIntBefore('\n');
             if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
               sockets[mux]->got_data = true;
             }
-            data = "";
+            response.clear();
+            match.reset();
             DBG("### Got Data:", mux);
-          } else {
-            data += mode;
           }
-        } else if (data.endsWith(GF(GSM_NL "+RECEIVE:"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          int len = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcReceive) {
+          int mux = streamGetIntBefore(',');
+          int len = streamGetIntBefore('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->got_data = true;
-            sockets[mux]->sock_available = len;
+            sockets[mux]->sock_available = len;  // No need to ask
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Got Data:", len, "on", mux);
-        } else if (data.endsWith(GF("CLOSED" GSM_NL))) {
-          int nl = data.lastIndexOf(GSM_NL, data.length()-8);
-          int coma = data.indexOf(',', nl+2);
-          int mux = data.substring(nl+2, coma).toInt();
+        } else if (hit == urcClosed) {
+          int mux = atoi(response.lineStart(8));
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Closed: ", mux);
+        } else if (hit == urcConnectOk || hit == urcConnectFail) {
+          bool ok = hit == urcConnectOk;
+          int mux = atoi(response.lineStart(ok ? 12 : 14));
+          if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux] &&
+              sockets[mux]->connect_state == CONNECT_PENDING) {
+            sockets[mux]->sock_connected = ok;
+            sockets[mux]->connect_state = ok ? CONNECT_DONE : CONNECT_FAILED;
+          }
+          response.clear();
+          match.reset();
+          DBG("### Connect:", ok, "on", mux);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -1003,6 +1040,11 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
+  TinyGsmInterval reconcile;
 };
 
 #endif
@@ -18,6 +18,12 @@
 #endif
 
 #define TINY_GSM_MUX_COUNT 5
+#define TINY_GSM_MODEM_HAS_READ_AHEAD
+#if defined(TINY_GSM_USE_HEX)
+  #define TINY_GSM_MODEM_READ_CHUNK 730   // Most one +CIPRXGET returns
+#else
+  #define TINY_GSM_MODEM_READ_CHUNK 1460
+#endif
 
 #include <TinyGsmCommon.h>
 
@@ -69,9 +75,10 @@ public:
     this->at = modem;
     this->mux = mux;
     sock_available = 0;
-    prev_check = 0;
+    poll_check.reset();
     sock_connected = false;
     got_data = false;
+    connect_state = CONNECT_IDLE;
 
     at->sockets[mux] = this;
 
@@ -89,6 +96,19 @@ public:
 
 TINY_GSM_CLIENT_CONNECT_OVERLOADS()
 
+  // Starts connecting and returns right away, see poll()
+  virtual bool connectAsync(const char *host, uint16_t port, int timeout_s = 75) {
+    stop();
+    TINY_GSM_YIELD();
+    rx.clear();
+    connect_started = millis();
+    connect_timeout_ms = (uint32_t)timeout_s * 1000;
+    connect_state = at->modemConnectStart(host, port, mux, false) ? CONNECT_PENDING : CONNECT_FAILED;
+    return connect_state == CONNECT_PENDING;
+  }
+
+TINY_GSM_CLIENT_CONNECT_ASYNC()
+
   virtual void stop(uint32_t maxWaitMs) {
     TINY_GSM_CLIENT_DUMP_MODEM_BUFFER()
     at->sendAT(GF("+CIPCLOSE="), mux, GF(",1"));  // Quick close
@@ -104,7 +124,7 @@ TINY_GSM_CLIENT_AVAILABLE_WITH_BUFFER_CHECK()
 
 TINY_GSM_CLIENT_READ_WITH_BUFFER_CHECK()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -116,10 +136,16 @@ private:
   TinyGsmSim800*  at;
   uint8_t         mux;
   uint16_t        sock_available;
-  uint32_t        prev_check;
+  TinyGsmPollScheduler poll_check;
   bool            sock_connected;
   bool            got_data;
+  uint8_t         connect_state;
+  uint32_t        connect_started;
+  uint32_t        connect_timeout_ms;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -142,6 +168,16 @@ public:
     sock_connected = at->modemConnect(host, port, mux, true, timeout_s);
     return sock_connected;
   }
+
+  virtual bool connectAsync(const char *host, uint16_t port, int timeout_s = 75) {
+    stop();
+    TINY_GSM_YIELD();
+    rx.clear();
+    connect_started = millis();
+    connect_timeout_ms = (uint32_t)timeout_s * 1000;
+    connect_state = at->modemConnectStart(host, port, mux, true) ? CONNECT_PENDING : CONNECT_FAILED;
+    return connect_state == CONNECT_PENDING;
+  }
 };
 
 
@@ -149,6 +185,8 @@ public:
 
   TinyGsmSim800(Stream& stream)
     : stream(stream)
+    , warm(NULL)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -168,17 +206,51 @@ public:
     if (!testAT()) {
       return false;
     }
+    // Nothing is sent along with these: the modem resets, and drops what
+    // comes in meanwhile
     sendAT(GF("&FZ"));  // Factory + Reset
     waitResponse();
     sendAT(GF("E0"));   // Echo Off
     if (waitResponse() != 1) {
       return false;
     }
-    DBG(GF("### Modem:"), getModemName());
-    getSimStatus();
+    String name = getModemName();
+    DBG(GF("### Modem:"), name);
+    SimStatus sim = getSimStatus();
+    if (warm) {
+      String imei = getIMEI();
+      warm->clear();
+      strncpy(warm->imei, imei.c_str(), sizeof(warm->imei) - 1);
+      strncpy(warm->model, name.c_str(), sizeof(warm->model) - 1);
+      warm->sim = sim;
+      if (imei.length()) {
+        warm->magic = TinyGsmWarmState::MAGIC;
+      }
+    }
     return true;
   }
 
+  // Like init(), but first tries to pick up where an earlier init(state)
+  // left off: if the modem answers one probe with the same IMEI and the SIM
+  // ready, nothing else is sent.  Otherwise it's set up as by init(), and
+  // state filled in for the next time.  The modem keeps using state, so it
+  // has to stay around.
+  bool init(TinyGsmWarmState& state, const char* pin = NULL) {
+    warm = &state;
+    if (state.valid()) {
+      sendAT(GF("E0+GSN;+CPIN?"));  // Echo off again, in case it was reset
+      String res;
+      if (waitResponse(1000L, res) == 1 && res.indexOf(state.imei) >= 0 &&
+          res.indexOf("+CPIN: READY") >= 0) {
+        DBG(GF("### Warm start:"), state.model);
+        return true;
+      }
+      DBG(GF("### Warm start failed"));
+    }
+    state.clear();
+    return init(pin);
+  }
+
   String getModemName() {
     String name = "";
     #if defined(TINY_GSM_MODEM_SIM800)
@@ -207,23 +279,27 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_CHECK_SOCKS()
 
+TINY_GSM_MODEM_RECONCILE_SOCKS_BATCHED()
+
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {
-    sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write
-    waitResponse();
-    sendAT(GF("+IPR=0"));   // Auto-baud
-    waitResponse();
-    sendAT(GF("+IFC=0,0")); // No Flow Control
-    waitResponse();
-    sendAT(GF("+ICF=3,3")); // 8 data 0 parity 1 stop
-    waitResponse();
-    sendAT(GF("+CSCLK=0")); // Disable Slow Clock
+    sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write, on its own
     waitResponse();
-    sendAT(GF("&W"));       // Write configuration
-    return waitResponse() == 1;
+    TinyGsmPipeline<TinyGsmSim800> batch(*this, false);
+    batch.send(1000L, GF("+IPR=0"));   // Auto-baud
+    batch.send(1000L, GF("+IFC=0,0")); // No Flow Control
+    batch.send(1000L, GF("+ICF=3,3")); // 8 data 0 parity 1 stop
+    batch.send(1000L, GF("+CSCLK=0")); // Disable Slow Clock
+    batch.send(1000L, GF("&W"));       // Write configuration
+    batch.finish();
+    return batch.ok(4);
   }
 
 TINY_GSM_MODEM_GET_INFO_ATI()
@@ -272,7 +348,11 @@ TINY_GSM_MODEM_GET_INFO_ATI()
     if (waitResponse(10000L) != 1) {
       return false;
     }
-    delay(3000);
+    // Wait as long as before, but no longer than the modem takes to report
+    // its SIM (it only does when not auto-bauding)
+    if (waitResponse(3000L, GF("+CPIN:")) == 1) {
+      streamSkipUntil('\n');
+    }
     return init();
   }
 
@@ -351,27 +431,33 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
    */
 
   bool gprsConnect(const char* apn, const char* user = NULL, const char* pwd = NULL) {
+    // Still up since before a warm start?
+    if (warm && warm->gprs && !strncmp(warm->apn, apn, sizeof(warm->apn)) &&
+        isGprsConnected()) {
+      return true;
+    }
+
     gprsDisconnect();
 
-    // Set the Bearer for the IP
-    sendAT(GF("+SAPBR=3,1,\"Contype\",\"GPRS\""));  // Set the connection type to GPRS
-    waitResponse();
+    // The bearer settings' results aren't checked, so they can be sent in one
+    // go.  What brings something up goes on its own, once what it depends on
+    // has answered.
+    TinyGsmPipeline<TinyGsmSim800> bearer(*this, false);
 
-    sendAT(GF("+SAPBR=3,1,\"APN\",\""), apn, '"');  // Set the APN
-    waitResponse();
+    // Set the Bearer for the IP
+    bearer.send(1000L, GF("+SAPBR=3,1,\"Contype\",\"GPRS\""));  // Set the connection type to GPRS
+    bearer.send(1000L, GF("+SAPBR=3,1,\"APN\",\""), apn, '"');  // Set the APN
 
     if (user && strlen(user) > 0) {
-      sendAT(GF("+SAPBR=3,1,\"USER\",\""), user, '"');  // Set the user name
-      waitResponse();
+      bearer.send(1000L, GF("+SAPBR=3,1,\"USER\",\""), user, '"');  // Set the user name
     }
     if (pwd && strlen(pwd) > 0) {
-      sendAT(GF("+SAPBR=3,1,\"PWD\",\""), pwd, '"');  // Set the password
-      waitResponse();
+      bearer.send(1000L, GF("+SAPBR=3,1,\"PWD\",\""), pwd, '"');  // Set the password
     }
 
     // Define the PDP context
-    sendAT(GF("+CGDCONT=1,\"IP\",\""), apn, '"');
-    waitResponse();
+    bearer.send(1000L, GF("+CGDCONT=1,\"IP\",\""), apn, '"');
+    bearer.finish();
 
     // Activate the PDP context
     sendAT(GF("+CGACT=1,1"));
@@ -380,6 +466,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     // Open the definied GPRS bearer context
     sendAT(GF("+SAPBR=1,1"));
     waitResponse(85000L);
+
     // Query the GPRS bearer context status
     sendAT(GF("+SAPBR=2,1"));
     if (waitResponse(30000L) != 1)
@@ -392,27 +479,22 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
 
     // TODO: wait AT+CGATT?
 
+    // From here on, the first command that fails ends it
+    TinyGsmPipeline<TinyGsmSim800> gprs(*this);
+
     // Set to multi-IP
-    sendAT(GF("+CIPMUX=1"));
-    if (waitResponse() != 1) {
-      return false;
-    }
+    gprs.send(1000L, GF("+CIPMUX=1"));
 
     // Put in "quick send" mode (thus no extra "Send OK")
-    sendAT(GF("+CIPQSEND=1"));
-    if (waitResponse() != 1) {
-      return false;
-    }
+    gprs.send(1000L, GF("+CIPQSEND=1"));
 
     // Set to get data manually
-    sendAT(GF("+CIPRXGET=1"));
-    if (waitResponse() != 1) {
-      return false;
-    }
+    gprs.send(1000L, GF("+CIPRXGET=1"));
 
     // Start Task and Set APN, USER NAME, PASSWORD
-    sendAT(GF("+CSTT=\""), apn, GF("\",\""), user, GF("\",\""), pwd, GF("\""));
-    if (waitResponse(60000L) != 1) {
+    gprs.send(60000L, GF("+CSTT=\""), apn, GF("\",\""), user, GF("\",\""), pwd, GF("\""));
+
+    if (!gprs.finish()) {
       return false;
     }
 
@@ -422,22 +504,28 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
       return false;
     }
 
+    TinyGsmPipeline<TinyGsmSim800> ip(*this);
+
     // Get Local IP Address, only assigned after connection
-    sendAT(GF("+CIFSR;E0"));
-    if (waitResponse(10000L) != 1) {
-      return false;
-    }
+    ip.send(10000L, GF("+CIFSR;E0"));
 
     // Configure Domain Name Server (DNS)
-    sendAT(GF("+CDNSCFG=\"8.8.8.8\",\"8.8.4.4\""));
-    if (waitResponse() != 1) {
+    ip.send(1000L, GF("+CDNSCFG=\"8.8.8.8\",\"8.8.4.4\""));
+
+    if (!ip.finish()) {
       return false;
     }
-
+    if (warm && strlen(apn) < sizeof(warm->apn)) {
+      strcpy(warm->apn, apn);
+      warm->gprs = 1;
+    }
     return true;
   }
 
   bool gprsDisconnect() {
+    if (warm) {
+      warm->gprs = 0;
+    }
     // Shut the TCP/IP connection
     // CIPSHUT will close *all* open connections
     sendAT(GF("+CIPSHUT"));
@@ -456,7 +544,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+CGATT:")) != 1) {
       return false;
     }
-    int res = stream.readStringUntil('\n').toInt();
+    int res = streamGetIntBefore('\n');
     waitResponse();
     if (res != 1)
       return false;
@@ -474,14 +562,10 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
 
   String getLocalIP() {
     sendAT(GF("+CIFSR;E0"));
-    String res;
-    if (waitResponse(10000L, res) != 1) {
+    if (waitResponse(10000L) != 1) {
       return "";
     }
-    res.replace(GSM_NL "OK" GSM_NL, "");
-    res.replace(GSM_NL, "");
-    res.trim();
-    return res;
+    return responseBody();
   }
 
   IPAddress localIP() {
@@ -557,7 +641,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     stream.readStringUntil('"');
     String hex = stream.readStringUntil('"');
     stream.readStringUntil(',');
-    int dcs = stream.readStringUntil('\n').toInt();
+    int dcs = streamGetIntBefore('\n');
 
     if (dcs == 15) {
       return TinyGsmDecodeHex8bit(hex);
@@ -667,7 +751,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     streamSkipUntil(','); // Skip battery charge status
     streamSkipUntil(','); // Skip battery charge level
     // return voltage in mV
-    uint16_t res = stream.readStringUntil(',').toInt();
+    uint16_t res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -680,7 +764,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     }
     streamSkipUntil(','); // Skip battery charge status
     // Read battery charge level
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -692,7 +776,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
       return false;
     }
     // Read battery charge status
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     // Wait for final OK
     waitResponse();
     return res;
@@ -703,9 +787,9 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+CBC:")) != 1) {
       return false;
     }
-    chargeState = stream.readStringUntil(',').toInt();
-    percent = stream.readStringUntil(',').toInt();
-    milliVolts = stream.readStringUntil('\n').toInt();
+    chargeState = streamGetIntBefore(',');
+    percent = streamGetIntBefore(',');
+    milliVolts = streamGetIntBefore('\n');
     // Wait for final OK
     waitResponse();
     return true;
@@ -780,24 +864,33 @@ protected:
   bool modemConnect(const char* host, uint16_t port, uint8_t mux,
                     bool ssl = false, int timeout_s = 75)
  {
-    int rsp;
     uint32_t timeout_ms = ((uint32_t)timeout_s)*1000;
+    if (!modemConnectStart(host, port, mux, ssl)) {
+      return false;
+    }
+    int rsp = waitResponse(timeout_ms,
+                           GF("CONNECT OK" GSM_NL),
+                           GF("CONNECT FAIL" GSM_NL),
+                           GF("ALREADY CONNECT" GSM_NL),
+                           GF("ERROR" GSM_NL),
+                           GF("CLOSE OK" GSM_NL)   // Happens when HTTPS handshake fails
+                          );
+    return (1 == rsp);
+  }
+
+  // Sends the connect command and leaves the result, "<mux>, CONNECT OK" or
+  // "<mux>, CONNECT FAIL", to be picked up by waitResponse()
+  bool modemConnectStart(const char* host, uint16_t port, uint8_t mux,
+                         bool ssl = false)
+  {
 #if !defined(TINY_GSM_MODEM_SIM900)
     sendAT(GF("+CIPSSL="), ssl);
-    rsp = waitResponse();
-    if (ssl && rsp != 1) {
+    if (waitResponse() != 1 && ssl) {
       return false;
     }
 #endif
     sendAT(GF("+CIPSTART="), mux, ',', GF("\"TCP"), GF("\",\""), host, GF("\","), port);
-    rsp = waitResponse(timeout_ms,
-                       GF("CONNECT OK" GSM_NL),
-                       GF("CONNECT FAIL" GSM_NL),
-                       GF("ALREADY CONNECT" GSM_NL),
-                       GF("ERROR" GSM_NL),
-                       GF("CLOSE OK" GSM_NL)   // Happens when HTTPS handshake fails
-                      );
-    return (1 == rsp);
+    return waitResponse() == 1;
   }
 
   int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
@@ -811,43 +904,42 @@ protected:
       return 0;
     }
     streamSkipUntil(','); // Skip mux
-    return stream.readStringUntil('\n').toInt();
+    return streamGetIntBefore('\n');
   }
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  size_t modemRead(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    modemReadAsk(size, mux);
+    return modemReadAnswer(size, mux, dst);
+  }
+
+  void modemReadAsk(size_t size, uint8_t mux) {
 #ifdef TINY_GSM_USE_HEX
     sendAT(GF("+CIPRXGET=3,"), mux, ',', size);
-    if (waitResponse(GF("+CIPRXGET:")) != 1) {
-      return 0;
-    }
 #else
     sendAT(GF("+CIPRXGET=2,"), mux, ',', size);
+#endif
+  }
+
+  // The answer says how much it carries, so the size asked for isn't needed
+  size_t modemReadAnswer(size_t, uint8_t mux, uint8_t* dst = NULL) {
+    TINY_GSM_PROFILE(modemRead);
     if (waitResponse(GF("+CIPRXGET:")) != 1) {
       return 0;
     }
-#endif
     streamSkipUntil(','); // Skip Rx mode 2/normal or 3/HEX
     streamSkipUntil(','); // Skip mux
-    size_t len_requested = stream.readStringUntil(',').toInt();
+    size_t len_requested = streamGetIntBefore(',');
     //  ^^ Requested number of data bytes (1-1460 bytes)to be read
-    size_t len_confirmed = stream.readStringUntil('\n').toInt();
+    size_t len_confirmed = streamGetIntBefore('\n');
     // ^^ Confirmed number of data bytes to be read, which may be less than requested.
     // 0 indicates that no data can be read.
     // This is actually be the number of bytes that will be remaining after the read
-    for (size_t i=0; i<len_requested; i++) {
-      uint32_t startMillis = millis();
 #ifdef TINY_GSM_USE_HEX
-      while (stream.available() < 2 && (millis() - startMillis < sockets[mux]->_timeout)) { TINY_GSM_YIELD(); }
-      char buf[4] = { 0, };
-      buf[0] = stream.read();
-      buf[1] = stream.read();
-      char c = strtol(buf, NULL, 16);
+    size_t got = streamReadHexToFifo(sockets[mux]->rx, len_requested, sockets[mux]->_timeout, dst);
 #else
-      while (!stream.available() && (millis() - startMillis < sockets[mux]->_timeout)) { TINY_GSM_YIELD(); }
-      char c = stream.read();
+    size_t got = streamReadToFifo(sockets[mux]->rx, len_requested, sockets[mux]->_timeout, dst);
 #endif
-      sockets[mux]->rx.put(c);
-    }
+    if (dst) len_requested = got;  // Only what came in is in the caller's buffer
     DBG("### READ:", len_requested, "from", mux);
     // sockets[mux]->sock_available = modemGetAvailable(mux);
     sockets[mux]->sock_available = len_confirmed;
@@ -855,29 +947,51 @@ protected:
     return len_requested;
   }
 
+TINY_GSM_MODEM_READ_AHEAD()
+
   size_t modemGetAvailable(uint8_t mux) {
     sendAT(GF("+CIPRXGET=4,"), mux);
     size_t result = 0;
     if (waitResponse(GF("+CIPRXGET:")) == 1) {
       streamSkipUntil(','); // Skip mode 4
       streamSkipUntil(','); // Skip mux
-      result = stream.readStringUntil('\n').toInt();
+      result = streamGetIntBefore('\n');
       waitResponse();
     }
     DBG("### Available:", result, "on", mux);
-    if (!result) {
-      sockets[mux]->sock_connected = modemGetConnected(mux);
-    }
     return result;
   }
 
+  // Updates the state of all sockets, the modem lists them all anyway
   bool modemGetConnected(uint8_t mux) {
-    sendAT(GF("+CIPSTATUS="), mux);
-    waitResponse(GF("+CIPSTATUS"));
-    int res = waitResponse(GF(",\"CONNECTED\""), GF(",\"CLOSED\""), GF(",\"CLOSING\""),
-                           GF(",\"REMOTE CLOSING\""), GF(",\"INITIAL\""));
-    waitResponse();
-    return 1 == res;
+    sendAT(GF("+CIPSTATUS"));
+    if (waitResponse() != 1) {
+      return false;
+    }
+    // OK comes first, then the IP state and a line for each connection:
+    // C: 0,0,"TCP","151.139.237.11","80","CONNECTED"
+    bool res = false;
+    for (int i = 0; i < 6; i++) {
+      if (waitResponse(GF("C: ")) != 1) {
+        break;
+      }
+      int muxNo = streamGetIntBefore(',');
+      streamSkipUntil(','); // Skip bearer
+      streamSkipUntil(','); // Skip socket type
+      streamSkipUntil(','); // Skip remote ip
+      streamSkipUntil(','); // Skip remote port
+      bool connected = waitResponse(GF("\"CONNECTED\""), GF(GSM_NL)) == 1;
+      if (connected) {
+        streamSkipUntil('\n');
+      }
+      if (muxNo >= 0 && muxNo < TINY_GSM_MUX_COUNT && sockets[muxNo]) {
+        sockets[muxNo]->sock_connected = connected;
+      }
+      if (muxNo == mux) {
+        res = connected;
+      }
+    }
+    return res;
   }
 
 public:
@@ -888,18 +1002,30 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
+    TINY_GSM_READ_AHEAD_SETTLE(*this);  // Its answer comes first
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<10> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcRxGet = match.add(GF(GSM_NL "+CIPRXGET:"));
+    const uint8_t urcReceive = match.add(GF(GSM_NL "+RECEIVE:"));
+    const uint8_t urcClosed = match.add(GF("CLOSED" GSM_NL));
+    const uint8_t urcConnectOk = match.add(GF("CONNECT OK" GSM_NL));
+    const uint8_t urcConnectFail = match.add(GF("CONNECT FAIL" GSM_NL));
     int index = 0;
     unsigned long startMillis = millis();
     do {
@@ -907,74 +1033,80 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
       while (stream.available() > 0) {
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (match.longest() == urcConnectOk || match.longest() == urcConnectFail) {
+          hit = match.longest();  // Not the "OK" of a response
+        }
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
           goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+CIPRXGET:"))) {
-          String mode = stream.readStringUntil(',');
-          if (mode.toInt() == 1) {
-            int mux = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcRxGet) {
+          int mode = streamGetIntBefore(',');
+          if (mode == 1) {
+            int mux = streamGetIntBefore('\n');
             if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
               sockets[mux]->got_data = true;
             }
-            data = "";
+            response.clear();
+            match.reset();
             DBG("### Got Data:", mux);
-          } else {
-            data += mode;
           }
-        } else if (data.endsWith(GF(GSM_NL "+RECEIVE:"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          int len = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcReceive) {
+          int mux = streamGetIntBefore(',');
+          int len = streamGetIntBefore('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->got_data = true;
-            sockets[mux]->sock_available = len;
+            sockets[mux]->sock_available = len;  // No need to ask
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Got Data:", len, "on", mux);
-        } else if (data.endsWith(GF("CLOSED" GSM_NL))) {
-          int nl = data.lastIndexOf(GSM_NL, data.length()-8);
-          int coma = data.indexOf(',', nl+2);
-          int mux = data.substring(nl+2, coma).toInt();
+        } else if (hit == urcClosed) {
+          int mux = atoi(response.lineStart(8));
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### Closed: ", mux);
+        } else if (hit == urcConnectOk || hit == urcConnectFail) {
+          bool ok = hit == urcConnectOk;
+          int mux = atoi(response.lineStart(ok ? 12 : 14));
+          if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux] &&
+              sockets[mux]->connect_state == CONNECT_PENDING) {
+            sockets[mux]->sock_connected = ok;
+            sockets[mux]->connect_state = ok ? CONNECT_DONE : CONNECT_FAILED;
+          }
+          response.clear();
+          match.reset();
+          DBG("### Connect:", ok, "on", mux);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    TINY_GSM_READ_AHEAD_SETTLE(*this);  // Not into data
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -988,6 +1120,15 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmWarmState* warm;
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
+  TinyGsmInterval reconcile;
+#if TINY_GSM_READ_AHEAD
+  TinyGsmReadAhead ahead;
+#endif
 };
 
 #endif
@@ -64,9 +64,10 @@ public:
     this->at = modem;
     this->mux = mux;
     sock_available = 0;
-    prev_check = 0;
+    poll_check.reset();
     sock_connected = false;
     got_data = false;
+    connect_state = CONNECT_IDLE;
 
     at->sockets[mux] = this;
 
@@ -93,6 +94,13 @@ public:
 
 TINY_GSM_CLIENT_CONNECT_OVERLOADS()
 
+  // Starts connecting and returns right away, see poll()
+  virtual bool connectAsync(const char *host, uint16_t port, int timeout_s = 75) {
+    return startConnect(host, port, false, timeout_s);
+  }
+
+TINY_GSM_CLIENT_CONNECT_ASYNC()
+
   virtual void stop(uint32_t maxWaitMs) {
     TINY_GSM_CLIENT_DUMP_MODEM_BUFFER()
     at->sendAT(GF("+USOCL="), mux);
@@ -108,7 +116,7 @@ TINY_GSM_CLIENT_AVAILABLE_WITH_BUFFER_CHECK()
 
 TINY_GSM_CLIENT_READ_WITH_BUFFER_CHECK()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -116,14 +124,38 @@ TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
 
   String remoteIP() TINY_GSM_ATTR_NOT_IMPLEMENTED;
 
+protected:
+  bool startConnect(const char *host, uint16_t port, bool ssl, int timeout_s) {
+    stop();
+    TINY_GSM_YIELD();
+    rx.clear();
+    connect_started = millis();
+    connect_timeout_ms = (uint32_t)timeout_s * 1000;
+    uint8_t oldMux = mux;
+    bool started = at->modemConnectStart(host, port, &mux, ssl);
+    if (mux != oldMux) {
+        DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
+        at->sockets[oldMux] = NULL;
+    }
+    at->sockets[mux] = this;
+    connect_state = started ? CONNECT_PENDING : CONNECT_FAILED;
+    return started;
+  }
+
 private:
   TinyGsmSaraR4*   at;
   uint8_t         mux;
   uint16_t        sock_available;
-  uint32_t        prev_check;
+  TinyGsmPollScheduler poll_check;
   bool            sock_connected;
   bool            got_data;
+  uint8_t         connect_state;
+  uint32_t        connect_started;
+  uint32_t        connect_timeout_ms;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -153,6 +185,10 @@ public:
     at->maintain();
     return sock_connected;
   }
+
+  virtual bool connectAsync(const char *host, uint16_t port, int timeout_s = 75) {
+    return startConnect(host, port, true, timeout_s);
+  }
 };
 
 
@@ -160,6 +196,7 @@ public:
 
   TinyGsmSaraR4(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -233,10 +270,16 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
 TINY_GSM_MODEM_MAINTAIN_CHECK_SOCKS()
 
+TINY_GSM_MODEM_RECONCILE_SOCKS()
+
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {
     sendAT(GF("&F"));  // Resets the current profile, other NVM not affected
     return waitResponse() == 1;
@@ -301,9 +344,8 @@ TINY_GSM_MODEM_GET_SIMCCID_CCID()
     if (waitResponse(GF(GSM_NL)) != 1) {
       return "";
     }
-    String res = stream.readStringUntil('\n');
+    String res = streamGetStringBefore('\n');
     waitResponse();
-    res.trim();
     return res;
   }
 
@@ -424,7 +466,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
       return "";
     }
     streamSkipUntil(',');  // Skip context id
-    String res = stream.readStringUntil('\r');
+    String res = streamGetStringBefore('\r');
     if (waitResponse() != 1) {
       return "";
     }
@@ -498,7 +540,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
       return 0;
     }
 
-    int res = stream.readStringUntil(',').toInt();
+    int res = streamGetIntBefore(',');
     int8_t percent = res*20;  // return is 0-5
     // Wait for final OK
     waitResponse();
@@ -523,7 +565,7 @@ TINY_GSM_MODEM_GET_GPRS_IP_CONNECTED()
       return (float)-9999;
     }
     streamSkipUntil(','); // Skip units (C/F)
-    int16_t res = stream.readStringUntil('\n').toInt();
+    int16_t res = streamGetIntBefore('\n');
     float temp = -9999;
     if (res != 655355) {
       temp = ((float)res)/10;
@@ -541,11 +583,34 @@ protected:
                     bool ssl = false, int timeout_s = 120)
   {
     uint32_t timeout_ms = ((uint32_t)timeout_s)*1000;
+    if (!modemOpenSocket(mux, ssl)) {
+      return false;
+    }
+
+    // connect on the allocated socket
+    sendAT(GF("+USOCO="), *mux, ",\"", host, "\",", port);
+    int rsp = waitResponse(timeout_ms);
+    return (1 == rsp);
+  }
+
+  // Connects in the background, the modem reports the result with
+  // +UUSOCO: <mux>,<err> for waitResponse() to pick up
+  bool modemConnectStart(const char* host, uint16_t port, uint8_t* mux,
+                         bool ssl = false)
+  {
+    if (!modemOpenSocket(mux, ssl)) {
+      return false;
+    }
+    sendAT(GF("+USOCO="), *mux, ",\"", host, "\",", port, GF(",1"));
+    return waitResponse() == 1;
+  }
+
+  bool modemOpenSocket(uint8_t* mux, bool ssl) {
     sendAT(GF("+USOCR=6"));  // create a socket
     if (waitResponse(GF(GSM_NL "+USOCR:")) != 1) {  // reply is +USOCR: ## of socket created
       return false;
     }
-    *mux = stream.readStringUntil('\n').toInt();
+    *mux = streamGetIntBefore('\n');
     waitResponse();
 
     if (ssl) {
@@ -560,11 +625,7 @@ protected:
     // Enable KEEPALIVE, 30 sec
     //sendAT(GF("+USOSO="), *mux, GF(",6,2,30000"));
     //waitResponse();
-
-    // connect on the allocated socket
-    sendAT(GF("+USOCO="), *mux, ",\"", host, "\",", port);
-    int rsp = waitResponse(timeout_ms);
-    return (1 == rsp);
+    return true;
   }
 
   int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
@@ -580,30 +641,34 @@ protected:
       return 0;
     }
     streamSkipUntil(','); // Skip mux
-    int sent = stream.readStringUntil('\n').toInt();
+    int sent = streamGetIntBefore('\n');
     waitResponse();  // sends back OK after the confirmation of number sent
     return sent;
   }
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  size_t modemRead(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    TINY_GSM_PROFILE(modemRead);
     sendAT(GF("+USORD="), mux, ',', size);
     if (waitResponse(GF(GSM_NL "+USORD:")) != 1) {
       return 0;
     }
     streamSkipUntil(','); // Skip mux
-    size_t len = stream.readStringUntil(',').toInt();
+    size_t len = streamGetIntBefore(',');
     streamSkipUntil('\"');
 
-    for (size_t i=0; i<len; i++) {
-      TINY_GSM_MODEM_STREAM_TO_MUX_FIFO_WITH_DOUBLE_TIMEOUT
-    }
+    size_t got = streamReadToFifo(sockets[mux]->rx, len, sockets[mux]->_timeout, dst);
+    if (dst) len = got;  // Only what came in is in the caller's buffer
     streamSkipUntil('\"');
+    // What +UUSORD said is there, less what's been read; a +UUSORD that comes
+    // with the OK has the new count
+    modemReadDone(sockets[mux], len, size);
     waitResponse();
     DBG("### READ:", len, "from", mux);
-    sockets[mux]->sock_available = modemGetAvailable(mux);
     return len;
   }
 
+TINY_GSM_MODEM_READ_DONE()
+
   size_t modemGetAvailable(uint8_t mux) {
     // NOTE:  Querying a closed socket gives an error "operation not allowed"
     sendAT(GF("+USORD="), mux, ",0");
@@ -613,13 +678,10 @@ protected:
     // that you have already told to close
     if (res == 1) {
       streamSkipUntil(','); // Skip mux
-      result = stream.readStringUntil('\n').toInt();
+      result = streamGetIntBefore('\n');
       // if (result) DBG("### DATA AVAILABLE:", result, "on", mux);
       waitResponse();
     }
-    if (!result) {
-      sockets[mux]->sock_connected = modemGetConnected(mux);
-    }
     DBG("### AVAILABLE:", result, "on", mux);
     return result;
   }
@@ -633,7 +695,7 @@ protected:
 
     streamSkipUntil(','); // Skip mux
     streamSkipUntil(','); // Skip type
-    int result = stream.readStringUntil('\n').toInt();
+    int result = streamGetIntBefore('\n');
     // 0: the socket is in INACTIVE status (it corresponds to CLOSED status
     // defined in RFC793 "TCP Protocol Specification" [112])
     // 1: the socket is in LISTEN status
@@ -658,18 +720,27 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=GFP(GSM_CME_ERROR), GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<8> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcRecv = match.add(GF("+UUSORD:"));
+    const uint8_t urcClosed = match.add(GF("+UUSOCL:"));
+    const uint8_t urcConnect = match.add(GF("+UUSOCO:"));
     int index = 0;
     unsigned long startMillis = millis();
     do {
@@ -678,63 +749,68 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          if (r3 == GFP(GSM_CME_ERROR)) {
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
+          if (index == 3 && r3 == GFP(GSM_CME_ERROR)) {
             streamSkipUntil('\n');  // Read out the error
           }
           goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (data.endsWith(GF("+UUSORD:"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          int len = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcRecv) {
+          int mux = streamGetIntBefore(',');
+          int len = streamGetIntBefore('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->got_data = true;
-            sockets[mux]->sock_available = len;
+            sockets[mux]->sock_available = len;  // All there is, no need to ask
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### URC Data Received:", len, "on", mux);
-        } else if (data.endsWith(GF("+UUSOCL:"))) {
-          int mux = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcClosed) {
+          int mux = streamGetIntBefore('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### URC Sock Closed: ", mux);
+        } else if (hit == urcConnect) {
+          int mux = streamGetIntBefore(',');
+          int err = streamGetIntBefore('\n');
+          if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux] &&
+              sockets[mux]->connect_state == CONNECT_PENDING) {
+            sockets[mux]->sock_connected = (0 == err);
+            sockets[mux]->connect_state = (0 == err) ? CONNECT_DONE : CONNECT_FAILED;
+          }
+          response.clear();
+          match.reset();
+          DBG("### URC Sock Connect:", mux, err);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=GFP(GSM_CME_ERROR), GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -748,6 +824,11 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
+  TinyGsmInterval reconcile;
 };
 
 #endif
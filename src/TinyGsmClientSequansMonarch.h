@@ -72,7 +72,7 @@ public:
     this->at = modem;
     this->mux = mux;
     sock_available = 0;
-    prev_check = 0;
+    poll_check.reset();
     sock_connected = false;
     got_data = false;
 
@@ -109,7 +109,7 @@ TINY_GSM_CLIENT_AVAILABLE_WITH_BUFFER_CHECK()
 
 TINY_GSM_CLIENT_READ_WITH_BUFFER_CHECK()
 
-TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED()
+TINY_GSM_CLIENT_FLUSH_CONNECTED()
 
   /*
    * Extended API
@@ -121,10 +121,13 @@ private:
   TinyGsmSequansMonarch* at;
   uint8_t         mux;
   uint16_t        sock_available;
-  uint32_t        prev_check;
+  TinyGsmPollScheduler poll_check;
   bool            sock_connected;
   bool            got_data;
   RxFifo          rx;
+#if TINY_GSM_TX_BUFFER
+  TinyGsmTxBuffer<TINY_GSM_TX_BUFFER> tx;
+#endif
 };
 
 
@@ -179,6 +182,7 @@ public:
 
   TinyGsmSequansMonarch(Stream& stream)
     : stream(stream)
+    , sendingStale(false)
   {
     memset(sockets, 0, sizeof(sockets));
   }
@@ -212,23 +216,32 @@ public:
 
 TINY_GSM_MODEM_SET_BAUD_IPR()
 
+TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC()
+
 TINY_GSM_MODEM_TEST_AT()
 
+TINY_GSM_MODEM_SEND_STALE()
+
   void maintain() {
+    sendStale();
     for (int mux = 1; mux <= TINY_GSM_MUX_COUNT; mux++) {
       GsmClient* sock = sockets[mux % TINY_GSM_MUX_COUNT];
       if (sock && sock->got_data) {
         sock->got_data = false;
         sock->sock_available = modemGetAvailable(mux);
-        // modemGetConnected() always checks the state of ALL socks
-        modemGetConnected();
       }
     }
+    reconcileSockets();
     while (stream.available()) {
       waitResponse(15, NULL, NULL);
   }
   }
 
+  // modemGetConnected() always checks the state of ALL socks
+TINY_GSM_MODEM_RECONCILE_SOCKS_BATCHED()
+
+TINY_GSM_MODEM_URC_HANDLERS()
+
   bool factoryDefault() {
     sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write
     waitResponse();
@@ -311,9 +324,8 @@ TINY_GSM_MODEM_SIM_UNLOCK_CPIN()
     if (waitResponse(GF(GSM_NL "+SQNCCID:")) != 1) {
       return "";
     }
-    String res = stream.readStringUntil('\n');
+    String res = streamGetStringBefore('\n');
     waitResponse();
-    res.trim();
     return res;
   }
 
@@ -402,7 +414,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(GF(GSM_NL "+CGATT:")) != 1) {
       return false;
     }
-    int res = stream.readStringUntil('\n').toInt();
+    int res = streamGetIntBefore('\n');
     waitResponse();
     if (res != 1)
       return false;
@@ -420,7 +432,7 @@ TINY_GSM_MODEM_WAIT_FOR_NETWORK()
     if (waitResponse(10000L, GF("+CGPADDR: 3,\"")) != 1) {
       return "";
     }
-    String res = stream.readStringUntil('\"');
+    String res = streamGetStringBefore('\"');
     waitResponse();
     return res;
   }
@@ -604,25 +616,27 @@ protected:
   }
 
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  size_t modemRead(size_t size, uint8_t mux, uint8_t* dst = NULL) {
+    TINY_GSM_PROFILE(modemRead);
     sendAT(GF("+SQNSRECV="), mux, ',', size);
     if (waitResponse(GF("+SQNSRECV: ")) != 1) {
       return 0;
     }
     streamSkipUntil(','); // Skip mux
-    size_t len = stream.readStringUntil('\n').toInt();
-    for (size_t i=0; i<len; i++) {
-      uint32_t startMillis = millis(); \
-      while (!stream.available() && ((millis() - startMillis) < sockets[mux % TINY_GSM_MUX_COUNT]->_timeout)) { TINY_GSM_YIELD(); } \
-      char c = stream.read(); \
-      sockets[mux % TINY_GSM_MUX_COUNT]->rx.put(c);
-    }
+    size_t len = streamGetIntBefore('\n');
+    size_t got = streamReadToFifo(sockets[mux % TINY_GSM_MUX_COUNT]->rx, len,
+                     sockets[mux % TINY_GSM_MUX_COUNT]->_timeout, dst);
+    if (dst) len = got;  // Only what came in is in the caller's buffer
     DBG("### Read:", len, "from", mux);
+    // What +SQNSRING said is there, less what's been read; a +SQNSRING that
+    // comes with the OK has the new count
+    modemReadDone(sockets[mux % TINY_GSM_MUX_COUNT], len, size);
     waitResponse();
-    sockets[mux % TINY_GSM_MUX_COUNT]->sock_available = modemGetAvailable(mux);
     return len;
   }
 
+TINY_GSM_MODEM_READ_DONE()
+
   size_t modemGetAvailable(uint8_t mux) {
     sendAT(GF("+SQNSI="), mux);
     size_t result = 0;
@@ -630,7 +644,7 @@ protected:
       streamSkipUntil(','); // Skip mux
       streamSkipUntil(','); // Skip total sent
       streamSkipUntil(','); // Skip total received
-      result = stream.readStringUntil(',').toInt();  // keep data not yet read
+      result = streamGetIntBefore(',');  // keep data not yet read
       waitResponse();
     }
     DBG("### Available:", result, "on", mux);
@@ -646,7 +660,7 @@ protected:
         break;
       };
       uint8_t status = 0;
-      // if (stream.readStringUntil(',').toInt() != muxNo) { // check the mux no
+      // if (streamGetIntBefore(',') != muxNo) { // check the mux no
       //   DBG("### Warning: misaligned mux numbers!");
       // }
       streamSkipUntil(',');  // skip mux [use muxNo]
@@ -661,11 +675,16 @@ protected:
       // SOCK_LISTENING              = 4,
       // SOCK_INCOMING               = 5,
       // SOCK_OPENING                = 6,
-      sockets[muxNo % TINY_GSM_MUX_COUNT]->sock_connected = \
-        ((status != SOCK_CLOSED) && (status != SOCK_INCOMING) && (status != SOCK_OPENING));
+      GsmClient* sock = sockets[muxNo % TINY_GSM_MUX_COUNT];
+      if (sock) {
+        sock->sock_connected = ((status != SOCK_CLOSED) &&
+                                (status != SOCK_INCOMING) &&
+                                (status != SOCK_OPENING));
+      }
     }
     waitResponse();  // Should be an OK at the end
-    return sockets[mux % TINY_GSM_MUX_COUNT]->sock_connected;
+    GsmClient* sock = sockets[mux % TINY_GSM_MUX_COUNT];
+    return sock && sock->sock_connected;
   }
 
 public:
@@ -676,18 +695,26 @@ public:
 
 TINY_GSM_MODEM_STREAM_UTILITIES()
 
-  // TODO: Optimize this!
-  uint8_t waitResponse(uint32_t timeout_ms, String& data,
+  uint8_t waitResponse(uint32_t timeout_ms,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
+    TINY_GSM_PROFILE(waitResponse);
     /*String r1s(r1); r1s.trim();
     String r2s(r2); r2s.trim();
     String r3s(r3); r3s.trim();
     String r4s(r4); r4s.trim();
     String r5s(r5); r5s.trim();
     DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
-    data.reserve(64);
+    response.clear();
+    TinyGsmMatcher<7> match;
+    match.add(r1);
+    match.add(r2);
+    match.add(r3);
+    match.add(r4);
+    match.add(r5);
+    const uint8_t urcRing = match.add(GF(GSM_NL "+SQNSRING:"));
+    const uint8_t urcClosed = match.add(GF("SQNSH: "));
     int index = 0;
     unsigned long startMillis = millis();
     do {
@@ -696,60 +723,55 @@ TINY_GSM_MODEM_STREAM_UTILITIES()
         TINY_GSM_YIELD();
         int a = stream.read();
         if (a <= 0) continue; // Skip 0x00 bytes, just in case
-        data += (char)a;
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
+        response.add(a);
+        uint8_t hit = match.feed(a);
+        if (!hit) {
+          if (a == '\n') urcs.dispatch(response);
+          continue;
+        } else if (hit <= 5) {
+          index = hit;
           goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+SQNSRING:"))) {
-          int mux = stream.readStringUntil(',').toInt();
-          int len = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcRing) {
+          int mux = streamGetIntBefore(',');
+          int len = streamGetIntBefore('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux % TINY_GSM_MUX_COUNT]) {
-            sockets[mux % TINY_GSM_MUX_COUNT]->got_data = true;
+            // All there is, no need to ask
             sockets[mux % TINY_GSM_MUX_COUNT]->sock_available = len;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### URC Data Received:", len, "on", mux);
-        } else if (data.endsWith(GF("SQNSH: "))) {
-          int mux = stream.readStringUntil('\n').toInt();
+        } else if (hit == urcClosed) {
+          int mux = streamGetIntBefore('\n');
           if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux % TINY_GSM_MUX_COUNT]) {
             sockets[mux % TINY_GSM_MUX_COUNT]->sock_connected = false;
           }
-          data = "";
+          response.clear();
+          match.reset();
           DBG("### URC Sock Closed: ", mux);
         }
       }
     } while (millis() - startMillis < timeout_ms);
 finish:
     if (!index) {
-      data.trim();
-      if (data.length()) {
-        DBG("### Unhandled:", data);
+      response.trim();
+      if (response.length()) {
+        DBG("### Unhandled:", response.c_str());
       }
-      data = "";
+      response.clear();
     }
-    //data.replace(GSM_NL, "/");
-    //DBG('<', index, '>', data);
+    //DBG('<', index, '>', response.c_str());
     return index;
   }
 
-  uint8_t waitResponse(uint32_t timeout_ms,
+  uint8_t waitResponse(uint32_t timeout_ms, String& data,
                        GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
                        GsmConstStr r3=NULL, GsmConstStr r4=NULL, GsmConstStr r5=NULL)
   {
-    String data;
-    return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+    response.mirror(&data);
+    uint8_t index = waitResponse(timeout_ms, r1, r2, r3, r4, r5);
+    response.mirror(NULL);
+    return index;
   }
 
   uint8_t waitResponse(GsmConstStr r1=GFP(GSM_OK), GsmConstStr r2=GFP(GSM_ERROR),
@@ -763,6 +785,11 @@ public:
 
 protected:
   GsmClient*    sockets[TINY_GSM_MUX_COUNT];
+  TinyGsmResponseBuffer<TINY_GSM_RESPONSE_BUFFER> response;
+  TinyGsmUrcTable<TINY_GSM_URC_HANDLERS> urcs;
+  TinyGsmFlowControl flow;
+  bool          sendingStale;  // In sendStale(), which can call itself
+  TinyGsmInterval reconcile;
 };
 
 #endif
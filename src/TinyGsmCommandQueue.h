@@ -0,0 +1,210 @@
+/**
+ * @file       TinyGsmCommandQueue.h
+ * @author     TinyGSM contributors
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2026 TinyGSM contributors
+ * @date       Oct 2026
+ */
+
+#ifndef TinyGsmCommandQueue_h
+#define TinyGsmCommandQueue_h
+
+#include <TinyGsmRxPump.h>
+
+// Longest command (without the "AT") a queued transaction holds
+#ifndef TINY_GSM_QUEUE_CMD_LEN
+  #define TINY_GSM_QUEUE_CMD_LEN 32
+#endif
+
+// Least time the late answer to a command that timed out is waited for
+// before the next command is sent; it's the command's own timeout if longer
+#ifndef TINY_GSM_QUEUE_LATE_MS
+  #define TINY_GSM_QUEUE_LATE_MS 1000L
+#endif
+
+// Called when a queued command completes, with 1 for OK, 2 for ERROR (or
+// +CME ERROR) or 0 if the modem didn't answer in time, and the text received
+// up to and including the final line.  It runs inside tick(), and may queue
+// more commands.
+typedef void (*TinyGsmCommandDone)(uint8_t result, const String& text, void* arg);
+
+// Runs AT commands without waiting for the modem.  add() queues a command,
+// and tick(), called from the main loop, sends it and completes it once the
+// whole response has arrived, so the loop carries on with other work while
+// the modem takes its time.  In between commands, tick() lets the driver
+// handle the URC's that came in.
+//
+//   TinyGsmRxPump<256> pump(SerialAT);
+//   TinyGsm modem(pump);
+//   TinyGsmCommandQueue<TinyGsm, 256> queue(modem, pump);
+//   ...
+//   queue.add(GF("+CSQ"), onSignalQuality);
+//   ...
+//   // in loop():
+//   queue.tick();
+//
+// The modem has to read from a TinyGsmRxPump, which tick() looks ahead in
+// for the end of the response; the response has to fit into the pump.
+// Commands that time out may still be answered: that answer is skipped
+// before the next command goes out.
+//
+// The queue runs alongside the driver, it doesn't replace it: the driver's
+// functions, getSignalQuality(), gprsConnect() and the rest, still send and
+// wait for their commands themselves.  They can be called while the queue
+// isn't busy().  What the application wants to run without waiting, it
+// queues here and parses the answer in its callback.
+template<class Modem, uint16_t N, uint8_t Q = 4>
+class TinyGsmCommandQueue
+{
+public:
+  TinyGsmCommandQueue(Modem& modem, TinyGsmRxPump<N>& pump)
+    : modem(modem)
+    , pump(pump)
+    , first(0)
+    , count(0)
+    , sent(false)
+    , late(false)
+  {}
+
+  // Queues a command, returns false if the queue is full or the command too
+  // long.  The command completes on a line that is just ok (by default "OK")
+  // or error (by default "ERROR"), or that starts with "+CME ERROR:".
+  bool add(GsmConstStr cmd, TinyGsmCommandDone done = NULL, void* arg = NULL,
+           uint32_t timeout_ms = 1000L, GsmConstStr ok = NULL,
+           GsmConstStr error = NULL) {
+    size_t len = GSM_STR_LEN(cmd);
+    Transaction* t = slot(len, done, arg, timeout_ms, ok, error);
+    if (!t) return false;
+    for (size_t i = 0; i <= len; i++) {
+      t->cmd[i] = GSM_STR_CHAR(cmd, i);
+    }
+    return true;
+  }
+
+#if defined(__AVR__)
+  // A command put together in RAM
+  bool add(const char* cmd, TinyGsmCommandDone done = NULL, void* arg = NULL,
+           uint32_t timeout_ms = 1000L, GsmConstStr ok = NULL,
+           GsmConstStr error = NULL) {
+    Transaction* t = slot(strlen(cmd), done, arg, timeout_ms, ok, error);
+    if (!t) return false;
+    strcpy(t->cmd, cmd);
+    return true;
+  }
+#endif
+
+  // Sends, completes and times out commands; never waits for the modem
+  void tick() {
+    pump.poll();
+    if (sent) {
+      Transaction& t = queue[first];
+      uint8_t res = pump.fenceAtLine(t.ok ? t.ok : GF("OK"),
+                                     t.error ? t.error : GF("ERROR"),
+                                     GF("+CME ERROR:"));
+      if (res) {
+        // The whole response is in the pump: take it in up to the fence,
+        // along with any URC's before it
+        String text;
+        pump.peekFenced(text);
+        modem.waitResponse((uint32_t)0, NULL, NULL);
+        pump.unfence();
+        finish(res == 1 ? 1 : 2, text);
+      } else if (millis() - started > t.timeout) {
+        // Its answer may still come, and mustn't be taken for the next one's
+        late = true;
+        lateOk = t.ok;
+        lateError = t.error;
+        lateTimeout = TinyGsmMax(t.timeout, (uint32_t)TINY_GSM_QUEUE_LATE_MS);
+        started = millis();
+        finish(0, String());
+      }
+      return;
+    }
+    if (late) {
+      if (pump.fenceAtLine(lateOk ? lateOk : GF("OK"),
+                           lateError ? lateError : GF("ERROR"),
+                           GF("+CME ERROR:"))) {
+        modem.waitResponse((uint32_t)0, NULL, NULL);  // Dropped, URC's kept
+        pump.unfence();
+        late = false;
+      } else if (millis() - started > lateTimeout) {
+        late = false;  // Not coming after all
+      } else {
+        return;
+      }
+    }
+    if (pump.fenceLines()) {
+      // URC's, as far as they've arrived whole; the rest waits for later
+      modem.waitResponse((uint32_t)0, NULL, NULL);
+      pump.unfence();
+    }
+    if (count) {
+      modem.sendAT(queue[first].cmd);
+      started = millis();
+      sent = true;
+    }
+  }
+
+  // True while a command is waiting for its response, or the late answer to
+  // one that timed out is
+  bool busy() const {
+    return sent || late;
+  }
+
+  // Commands not completed yet, including the one sent
+  uint8_t pending() const {
+    return count;
+  }
+
+  // Drops the queued commands; one already sent still completes
+  void clear() {
+    count = sent ? 1 : 0;
+  }
+
+private:
+  struct Transaction {
+    char               cmd[TINY_GSM_QUEUE_CMD_LEN];
+    TinyGsmCommandDone done;
+    void*              arg;
+    uint32_t           timeout;
+    GsmConstStr        ok;
+    GsmConstStr        error;
+  };
+
+  // Takes the next free transaction, for a command of len characters
+  Transaction* slot(size_t len, TinyGsmCommandDone done, void* arg,
+                    uint32_t timeout_ms, GsmConstStr ok, GsmConstStr error) {
+    if (count >= Q || len >= TINY_GSM_QUEUE_CMD_LEN) return NULL;
+    Transaction* t = &queue[(first + count) % Q];
+    t->done = done;
+    t->arg = arg;
+    t->timeout = timeout_ms;
+    t->ok = ok;
+    t->error = error;
+    count++;
+    return t;
+  }
+
+  void finish(uint8_t res, const String& text) {
+    TinyGsmCommandDone done = queue[first].done;
+    void* arg = queue[first].arg;
+    first = (first + 1) % Q;
+    count--;
+    sent = false;
+    if (done) done(res, text, arg);
+  }
+
+  Modem&            modem;
+  TinyGsmRxPump<N>& pump;
+  Transaction       queue[Q];
+  uint8_t           first;
+  uint8_t           count;
+  bool              sent;
+  bool              late;  // Skipping the answer to a command that timed out
+  GsmConstStr       lateOk;
+  GsmConstStr       lateError;
+  uint32_t          lateTimeout;
+  uint32_t          started;
+};
+
+#endif
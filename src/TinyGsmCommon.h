@@ -34,10 +34,94 @@
   #define TINY_GSM_YIELD_MS 0
 #endif
 
+// Largest socket read requested at once when reading straight into the
+// caller's buffer.  The SIMCom modems return at most 730 bytes per
+// +CIPRXGET in HEX mode.
+#ifndef TINY_GSM_MAX_READ_CHUNK
+  #if defined(TINY_GSM_USE_HEX)
+    #define TINY_GSM_MAX_READ_CHUNK 730
+  #else
+    #define TINY_GSM_MAX_READ_CHUNK 1024
+  #endif
+#endif
+
+// Size of the per-socket buffer small writes are collected in before being
+// sent together.  0 (the default) sends every write() on its own.
+#ifndef TINY_GSM_TX_BUFFER
+  #define TINY_GSM_TX_BUFFER 0
+#endif
+
+// How long buffered outgoing data may wait for more to join it
+#ifndef TINY_GSM_TX_FLUSH_MS
+  #define TINY_GSM_TX_FLUSH_MS 100
+#endif
+
+// Set to 1 to ask the modem for socket data ahead of time, while the
+// application is still busy with what it has read.  0 (the default) only asks
+// the modem when the application waits for data.  See TinyGsmReadAhead.
+#ifndef TINY_GSM_READ_AHEAD
+  #define TINY_GSM_READ_AHEAD 0
+#endif
+
+// Shortest and longest interval between checks for data the modem didn't
+// announce, see TinyGsmPollScheduler
+#ifndef TINY_GSM_POLL_MIN_MS
+  #define TINY_GSM_POLL_MIN_MS 500
+#endif
+
+#ifndef TINY_GSM_POLL_MAX_MS
+  #define TINY_GSM_POLL_MAX_MS 16000
+#endif
+
+// How often maintain() double-checks with the modem which sockets are open.
+// Otherwise that's known from URC's alone.
+#ifndef TINY_GSM_RECONCILE_MS
+  #define TINY_GSM_RECONCILE_MS 30000L
+#endif
+
+// Commands a batch may send before the first of them has answered, see
+// TinyGsmPipeline.  1 (the default) waits for each answer before the next
+// command, as the modems' manuals ask for.
+#ifndef TINY_GSM_PIPELINE_DEPTH
+  #define TINY_GSM_PIPELINE_DEPTH 1
+#endif
+
+// "AT"s TinyGsmAutoBaud() sends at each rate, and how long it waits for an
+// answer to each on top of the time the answer takes on the line
+#ifndef TINY_GSM_AUTOBAUD_TRIES
+  #define TINY_GSM_AUTOBAUD_TRIES 5
+#endif
+
+#ifndef TINY_GSM_AUTOBAUD_WAIT_MS
+  #define TINY_GSM_AUTOBAUD_WAIT_MS 100
+#endif
+
+// Clean "AT" round trips negotiateBaud() wants at a new rate before it
+// settles on it
+#ifndef TINY_GSM_BAUD_CHECKS
+  #define TINY_GSM_BAUD_CHECKS 10
+#endif
+
+// Size of the buffer each modem object keeps for the text of AT responses
+#ifndef TINY_GSM_RESPONSE_BUFFER
+  #define TINY_GSM_RESPONSE_BUFFER 64
+#endif
+
+// Number of URC handlers an application can register with addUrcHandler()
+#ifndef TINY_GSM_URC_HANDLERS
+  #define TINY_GSM_URC_HANDLERS 4
+#endif
+
 #ifndef TINY_GSM_YIELD
   #define TINY_GSM_YIELD() { delay(TINY_GSM_YIELD_MS); }
 #endif
 
+// Marks the time spent in a section of a driver (waitResponse, modemRead).
+// Empty unless a profiler, e.g. tools/HostSim/SimBench, defines it.
+#ifndef TINY_GSM_PROFILE
+  #define TINY_GSM_PROFILE(section)
+#endif
+
 #define TINY_GSM_ATTR_NOT_AVAILABLE __attribute__((error("Not available on this modem type")))
 #define TINY_GSM_ATTR_NOT_IMPLEMENTED __attribute__((error("Not implemented")))
 
@@ -46,11 +130,15 @@
   typedef const __FlashStringHelper* GsmConstStr;
   #define GFP(x) (reinterpret_cast<GsmConstStr>(x))
   #define GF(x)  F(x)
+  #define GSM_STR_LEN(s)     strlen_P(reinterpret_cast<const char*>(s))
+  #define GSM_STR_CHAR(s, i) ((char)pgm_read_byte(reinterpret_cast<const char*>(s) + (i)))
 #else
   #define TINY_GSM_PROGMEM
   typedef const char* GsmConstStr;
   #define GFP(x) x
   #define GF(x)  x
+  #define GSM_STR_LEN(s)     strlen(s)
+  #define GSM_STR_CHAR(s, i) ((s)[i])
 #endif
 
 #ifdef TINY_GSM_DEBUG
@@ -92,23 +180,711 @@ const T& TinyGsmMax(const T& a, const T& b)
     return (b < a) ? a : b;
 }
 
+// Incremental matcher for the responses and URC prefixes waitResponse() is
+// looking for.  Every pattern only keeps the length of the prefix it has
+// matched so far, so a received byte is checked against all patterns without
+// re-scanning (or even keeping) the text that came before it.
+// NOTE:  Patterns are limited to 255 characters
+template<uint8_t N>
+class TinyGsmMatcher
+{
+public:
+  TinyGsmMatcher()
+    : count(0)
+    , longest_hit(0)
+  {}
+
+  // Adds a pattern and returns its 1-based slot number.  A NULL pattern takes
+  // a slot but never matches, so r1..r5 keep their numbering.
+  uint8_t add(GsmConstStr pattern) {
+    if (count >= N) return 0;
+    pat[count] = pattern;
+    len[count] = pattern ? GSM_STR_LEN(pattern) : 0;
+    pos[count] = 0;
+    next[count] = len[count] ? GSM_STR_CHAR(pattern, 0) : 0;
+    return ++count;
+  }
+
+  void reset() {
+    for (uint8_t i = 0; i < count; i++) {
+      pos[i] = 0;
+      next[i] = len[i] ? GSM_STR_CHAR(pat[i], 0) : 0;
+    }
+  }
+
+  // Feeds one received character, returns the lowest slot whose pattern the
+  // received text now ends with, or 0 if there is none.
+  uint8_t feed(char c) {
+    uint8_t hit = 0;
+    longest_hit = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      if (!len[i]) continue;
+      uint8_t p = pos[i];
+      if (c == next[i]) {
+        p++;
+        if (p == len[i]) {
+          if (!hit) hit = i + 1;
+          if (!longest_hit || len[i] > len[longest_hit - 1]) longest_hit = i + 1;
+          p = fallback(pat[i], p - 1, c);
+        }
+      } else if (p) {
+        p = fallback(pat[i], p, c);
+      } else {
+        continue;  // Fast path, nothing matched and still nothing matches
+      }
+      pos[i] = p;
+      next[i] = GSM_STR_CHAR(pat[i], p);
+    }
+    return hit;
+  }
+
+  // Of the slots the last feed() matched, the one with the longest pattern;
+  // tells "1, CONNECT OK" from a plain "OK"
+  uint8_t longest() const {
+    return longest_hit;
+  }
+
+private:
+  // Length of the longest prefix of the pattern that is a proper suffix of
+  // its first n characters followed by c.  Only needed after a partial match
+  // breaks, so it's done in place instead of keeping a KMP table per pattern.
+  static uint8_t fallback(GsmConstStr s, uint8_t n, char c) {
+    for (uint8_t k = n; k > 0; k--) {
+      if (GSM_STR_CHAR(s, k - 1) != c) continue;
+      uint8_t j = 0;
+      while (j < k - 1 && GSM_STR_CHAR(s, j) == GSM_STR_CHAR(s, n - k + 1 + j)) j++;
+      if (j == k - 1) return k;
+    }
+    return 0;
+  }
+
+  GsmConstStr pat[N];
+  uint8_t     len[N];
+  uint8_t     pos[N];
+  char        next[N];
+  uint8_t     count;
+  uint8_t     longest_hit;
+};
+
+// Fixed size buffer the modem collects AT response text in, so waitResponse()
+// never touches the heap.  When it fills up, the older half of the text is
+// dropped; the most recent text (the line being parsed) is always kept.
+// Callers that need a complete multi-line response as a String can have the
+// text mirrored into one for the duration of a single waitResponse().
+template<uint16_t N>
+class TinyGsmResponseBuffer
+{
+public:
+  TinyGsmResponseBuffer()
+    : copy(NULL)
+  {
+    clear();
+  }
+
+  void clear() {
+    len = 0;
+    buf[0] = '\0';
+    if (copy) *copy = "";
+  }
+
+  void add(char c) {
+    if (len >= N - 1) {
+      uint16_t keep = (N - 1) / 2;
+      memmove(buf, buf + len - keep, keep);
+      len = keep;
+    }
+    buf[len++] = c;
+    buf[len] = '\0';
+    if (copy) *copy += c;
+  }
+
+  // Strips leading and trailing whitespace
+  void trim() {
+    uint16_t start = 0;
+    while (start < len && isspace(buf[start])) start++;
+    while (len > start && isspace(buf[len - 1])) len--;
+    memmove(buf, buf + start, len - start);
+    len -= start;
+    buf[len] = '\0';
+  }
+
+  void mirror(String* s) {
+    copy = s;
+  }
+
+  uint16_t length() const {
+    return len;
+  }
+
+  const char* c_str() const {
+    return buf;
+  }
+
+  // Start of the line holding the character 'tail' places from the end
+  const char* lineStart(uint16_t tail) const {
+    uint16_t i = len > tail ? len - tail : 0;
+    while (i > 0 && buf[i - 1] != '\n') i--;
+    return buf + i;
+  }
+
+  // The line the last "\n" completed, without its line ending, or NULL if the
+  // text doesn't end with a complete line
+  const char* lastLine(uint16_t& n) const {
+    if (!len || buf[len - 1] != '\n') return NULL;
+    uint16_t end = len - 1;
+    if (end && buf[end - 1] == '\r') end--;
+    const char* start = lineStart(1);
+    n = buf + end - start;
+    return start;
+  }
+
+  // Removes the line lastLine() returns, line ending included
+  void dropLastLine() {
+    uint16_t start = lineStart(1) - buf;
+    if (copy) copy->remove(copy->length() - (len - start));
+    len = start;
+    buf[len] = '\0';
+  }
+
+private:
+  char     buf[N];
+  uint16_t len;
+  String*  copy;
+};
+
+// Called with an unsolicited result code an application registered for, as a
+// complete line without its line ending.  It runs inside waitResponse(), so
+// it must not send AT commands itself; set a flag and act on it later.
+typedef void (*TinyGsmUrcHandler)(const char* line, void* arg);
+
+// URC prefixes applications registered, and their handlers.  The modem
+// checks every line it receives that isn't part of an expected response,
+// once the line is complete.  A line that matches is passed to the handler
+// and removed from the response text.
+template<uint8_t N>
+class TinyGsmUrcTable
+{
+public:
+  TinyGsmUrcTable()
+    : count(0)
+  {}
+
+  // Registers a handler for lines starting with the prefix, e.g. "+CMTI:"
+  // or "RING".  Replaces the handler if the prefix is already registered.
+  bool add(GsmConstStr prefix, TinyGsmUrcHandler handler, void* arg) {
+    if (!prefix || !handler) return false;
+    uint8_t i = find(prefix);
+    if (i == count) {
+      if (count >= N) return false;
+      count++;
+    }
+    prefixes[i] = prefix;
+    handlers[i] = handler;
+    args[i] = arg;
+    return true;
+  }
+
+  bool remove(GsmConstStr prefix) {
+    uint8_t i = find(prefix);
+    if (i == count) return false;
+    count--;
+    for (; i < count; i++) {
+      prefixes[i] = prefixes[i + 1];
+      handlers[i] = handlers[i + 1];
+      args[i] = args[i + 1];
+    }
+    return true;
+  }
+
+  // Call when a "\n" was received.  Returns true if the line it completed
+  // was a registered URC.
+  template<uint16_t R>
+  bool dispatch(TinyGsmResponseBuffer<R>& response) {
+    if (!count) return false;
+    uint16_t n;
+    const char* text = response.lastLine(n);
+    if (!text || !n) return false;
+    for (uint8_t i = 0; i < count; i++) {
+      if (!startsWith(text, n, prefixes[i])) continue;
+      char line[R];
+      memcpy(line, text, n);
+      line[n] = '\0';
+      response.dropLastLine();
+      handlers[i](line, args[i]);
+      return true;
+    }
+    return false;
+  }
+
+private:
+  uint8_t find(GsmConstStr prefix) const {
+    uint8_t i = 0;
+    while (i < count && !same(prefixes[i], prefix)) i++;
+    return i;
+  }
+
+  static bool same(GsmConstStr a, GsmConstStr b) {
+    for (uint16_t i = 0; ; i++) {
+      char c = GSM_STR_CHAR(a, i);
+      if (c != GSM_STR_CHAR(b, i)) return false;
+      if (!c) return true;
+    }
+  }
+
+  static bool startsWith(const char* text, uint16_t n, GsmConstStr prefix) {
+    uint16_t len = GSM_STR_LEN(prefix);
+    if (!len || len > n) return false;
+    for (uint16_t i = 0; i < len; i++) {
+      if (text[i] != GSM_STR_CHAR(prefix, i)) return false;
+    }
+    return true;
+  }
+
+  GsmConstStr       prefixes[N];
+  TinyGsmUrcHandler handlers[N];
+  void*             args[N];
+  uint8_t           count;
+};
+
+// Outgoing socket data waiting to be sent in one go, see TINY_GSM_TX_BUFFER
+template<uint16_t N>
+class TinyGsmTxBuffer
+{
+public:
+  TinyGsmTxBuffer() {
+    clear();
+  }
+
+  void clear() {
+    len = 0;
+    failed = false;
+  }
+
+  // Copies in as much as fits, returns how much that was
+  size_t append(const uint8_t* p, size_t n) {
+    if (!len) since = millis();
+    if (n > (size_t)(N - len)) n = N - len;
+    memcpy(buf + len, p, n);
+    len += n;
+    return n;
+  }
+
+  // Drops the first n bytes, after they've been sent
+  void consume(size_t n) {
+    if (n >= len) {
+      len = 0;
+      return;
+    }
+    memmove(buf, buf + n, len - n);
+    len -= n;
+  }
+
+  bool full() const {
+    return len >= N;
+  }
+
+  // Milliseconds since the oldest byte still waiting was written
+  uint32_t age() const {
+    return len ? millis() - since : 0;
+  }
+
+  uint16_t length() const {
+    return len;
+  }
+
+  const uint8_t* data() const {
+    return buf;
+  }
+
+  // Marks that the modem didn't take what was waiting, it's been dropped
+  void fail() {
+    failed = true;
+  }
+
+  bool hasFailed() const {
+    return failed;
+  }
+
+private:
+  uint8_t  buf[N];
+  uint16_t len;
+  uint32_t since;
+  bool     failed;
+};
+
+// A socket read sent to the modem whose answer hasn't been taken in yet.
+//
+// With TINY_GSM_READ_AHEAD set, once read() has handed data to the
+// application the driver sends the read for the next chunk and returns
+// without waiting for it.  The modem answers while the application works on
+// what it got; the answer is taken in before the next command or when the
+// client runs out of data.  A chunk is as much as the modem hands out at once
+// (TINY_GSM_MODEM_READ_CHUNK), and is only asked for once the client's fifo
+// has room for it, so reading ahead sends no more commands than waiting
+// would.  A read() that goes straight into the caller's buffer doesn't send
+// one: the next such read is cheaper than taking the answer in through the
+// fifo.
+//
+// The answer waits in the UART (or a TinyGsmRxPump) until it's taken in, so
+// that has to hold a whole chunk, or use RTS/CTS flow control.  Only for
+// drivers that define TINY_GSM_MODEM_HAS_READ_AHEAD and
+// TINY_GSM_MODEM_READ_CHUNK; it's off for the others.
+struct TinyGsmReadAhead {
+  TinyGsmReadAhead() : mux(-1), size(0) {}
+
+  int8_t   mux;   // -1 if there's none out
+  uint16_t size;
+};
+
+#if TINY_GSM_READ_AHEAD && defined(TINY_GSM_MODEM_HAS_READ_AHEAD)
+  #define TINY_GSM_READ_AHEAD_SETTLE(modem) (modem).readAheadSettle()
+  #define TINY_GSM_READ_AHEAD_NEXT(modem) (modem).readAheadNext()
+#else
+  #define TINY_GSM_READ_AHEAD_SETTLE(modem)
+  #define TINY_GSM_READ_AHEAD_NEXT(modem)
+#endif
+
+// Lets something happen at most once every so many milliseconds
+class TinyGsmInterval
+{
+public:
+  TinyGsmInterval() : last(0), running(false) {}
+
+  // True once ms have passed since the last time; the first call only
+  // starts the clock
+  bool due(uint32_t ms) {
+    if (running && millis() - last < ms) return false;
+    bool first = !running;
+    restart();
+    return !first;
+  }
+
+  void restart() {
+    last = millis();
+    running = true;
+  }
+
+private:
+  uint32_t last;
+  bool     running;
+};
+
+// Decides when a socket checks with the modem for data that arrived without
+// a URC.  While data is flowing the URC's evidently work and there's no
+// check; once it stops, the first check comes after the shortest interval,
+// and each one that finds nothing doubles it up to the longest.  A check
+// that does find data drops back to the shortest.
+class TinyGsmPollScheduler
+{
+public:
+  struct Stats {
+    uint32_t checks;  // Checks sent
+    uint32_t missed;  // Checks that found data no URC had announced
+  };
+
+  TinyGsmPollScheduler() {
+    setPolicy(TINY_GSM_POLL_MIN_MS, TINY_GSM_POLL_MAX_MS);
+    reset();
+  }
+
+  // Equal intervals check at a fixed rate, as older versions did every 500ms
+  void setPolicy(uint16_t minMs, uint16_t maxMs) {
+    this->minMs = minMs;
+    this->maxMs = maxMs < minMs ? minMs : maxMs;
+    interval = minMs;
+  }
+
+  void reset() {
+    interval = minMs;
+    last = 0;
+    counters.checks = 0;
+    counters.missed = 0;
+  }
+
+  // True when a check is due; it's counted as sent
+  bool due() {
+    if (millis() - last < interval) return false;
+    last = millis();
+    counters.checks++;
+    return true;
+  }
+
+  // The outcome of the check due() asked for
+  void checked(bool found) {
+    if (found) {
+      counters.missed++;
+      interval = minMs;
+    } else if (interval < maxMs) {
+      interval = interval > maxMs / 2 ? maxMs : interval * 2;
+    }
+  }
+
+  // Data came in; the next check is the shortest interval after it stops
+  void activity() {
+    interval = minMs;
+    last = millis();
+  }
+
+  uint16_t minInterval() const {
+    return minMs;
+  }
+
+  uint16_t maxInterval() const {
+    return maxMs;
+  }
+
+  // Current interval between checks
+  uint16_t currentInterval() const {
+    return interval;
+  }
+
+  const Stats& stats() const {
+    return counters;
+  }
+
+private:
+  uint16_t minMs;
+  uint16_t maxMs;
+  uint16_t interval;
+  uint32_t last;
+  Stats    counters;
+};
+
+// Hardware flow control (RTS/CTS) between the host and the modem.  With it
+// on, data a modem pushes without being asked (ESP8266 "+IPD", A6
+// "+CIPRCV:", M590 "+TCPRECV:") that doesn't fit into the socket's buffer
+// is left in the UART until the application has read enough to make room,
+// and the modem waits, instead of the data being dropped.  Hosts whose UART
+// drives RTS by itself need nothing else; otherwise the RTS handler is told
+// when to hold the modem off (ready false) and when to let it go on.
+class TinyGsmFlowControl
+{
+public:
+  typedef void (*RtsHandler)(bool ready, void* arg);
+
+  TinyGsmFlowControl()
+    : on(false)
+    , rts(NULL)
+    , arg(NULL)
+    , mux(0)
+    , left(0)
+  {}
+
+  void enable(bool hw, RtsHandler handler, void* handlerArg) {
+    if (!hw && left) release();
+    on = hw;
+    rts = handler;
+    arg = handlerArg;
+  }
+
+  bool enabled() const {
+    return on;
+  }
+
+  // Pushed data for a socket is waiting in the UART, left bytes of it
+  void hold(uint8_t holdMux, size_t holdLeft) {
+    if (rts) rts(false, arg);
+    mux = holdMux;
+    left = holdLeft;
+  }
+
+  void release() {
+    left = 0;
+    if (rts) rts(true, arg);
+  }
+
+  bool holding() const {
+    return left != 0;
+  }
+
+  bool       on;
+  RtsHandler rts;
+  void*      arg;
+  uint8_t    mux;
+  size_t     left;
+};
+
+// For drivers whose modem pushes data (TINY_GSM_MODEM_PUSHES_DATA): true if a
+// push is held in the UART and still doesn't fit.  sendAT() doesn't send then,
+// as the answer would be stuck behind it, and the waitResponse() after it
+// fails.
+#if defined(TINY_GSM_MODEM_PUSHES_DATA)
+  #define TINY_GSM_PUSH_HELD(modem) (modem).pushHeld()
+#else
+  #define TINY_GSM_PUSH_HELD(modem) false
+#endif
+
+// Progress of a connect started with connectAsync()
+enum TinyGsmConnectState {
+  CONNECT_IDLE    = 0,  // None started
+  CONNECT_PENDING = 1,  // Waiting for the modem to report the result
+  CONNECT_DONE    = 2,
+  CONNECT_FAILED  = 3,
+};
+
+// Runs a batch of commands whose answers the driver only needs at the end,
+// keeping up to N of them on their way to the modem at once, instead of
+// paying the round trip for each.  The final results ("OK" or "ERROR") come
+// back in the order the commands were sent, which is how they are matched
+// up.  Once one has failed, the rest of the batch isn't sent, unless the
+// batch is made with stopOnFailure false.
+//
+//   TinyGsmPipeline<TinyGsmSim800> batch(*this);
+//   batch.send(1000L, GF("+CIPMUX=1"));
+//   batch.send(1000L, GF("+CIPRXGET=1"));
+//   if (!batch.finish()) ...
+//
+// Only worth it when commands can be sent while the one before is still
+// running; most modems take them from their UART buffer in turn.  Other
+// text in between (the "+SAPBR: ..." of a query, URC's) is handled by
+// waitResponse() as usual.
+template<class Modem, uint8_t N = TINY_GSM_PIPELINE_DEPTH>
+class TinyGsmPipeline
+{
+  static_assert(N > 0, "TinyGsmPipeline: N must be at least 1");
+
+public:
+  explicit TinyGsmPipeline(Modem& modem, bool stopOnFailure = true)
+    : modem(modem)
+    , stop(stopOnFailure)
+    , sent(0)
+    , done(0)
+    , failures(0)
+  {}
+
+  // Sends a command (without the "AT"), first waiting for the oldest one to
+  // answer if N are already on their way.  False if it wasn't sent because
+  // an earlier one failed.
+  template<typename... Args>
+  bool send(uint32_t timeout_ms, Args... cmd) {
+    if (sent - done >= N) collect();
+    if (stop && failures) return false;
+    modem.sendAT(cmd...);
+    timeouts[sent % N] = timeout_ms;
+    sent++;
+    return true;
+  }
+
+  // Waits for the answers to all commands sent, true if all were OK
+  bool finish() {
+    while (done != sent) collect();
+    return !failures;
+  }
+
+  // True if the n-th command sent (counting from 0, up to 31) answered OK;
+  // only known once finish() has returned
+  bool ok(uint8_t n) const {
+    return n < sent && n < 32 && !(failures & (1UL << n));
+  }
+
+private:
+  void collect() {
+    if (modem.waitResponse(timeouts[done % N]) != 1) {
+      failures |= done < 32 ? 1UL << done : 1UL << 31;
+    }
+    done++;
+  }
+
+  Modem&   modem;
+  bool     stop;
+  uint32_t timeouts[N];
+  uint8_t  sent;
+  uint8_t  done;
+  uint32_t failures;
+};
+
+// What the driver learned bringing the modem up, for the application to keep
+// across its own resets and deep sleeps (RTC memory, EEPROM...) while the
+// modem stays powered.  Passed to init(state), it lets the driver check with
+// one command that it's still the same modem, set up and with the SIM ready,
+// instead of setting it up again; gprsConnect() then keeps a bearer that is
+// still up.  Plain data, so it can be stored as it is.
+struct TinyGsmWarmState {
+  enum { MAGIC = 0x5401 };  // Changes with the layout
+
+  uint16_t magic;     // MAGIC once filled in by init()
+  uint32_t baud;      // For the application, e.g. what TinyGsmAutoBaud found
+  char     imei[16];
+  char     model[24];
+  uint8_t  sim;       // SimStatus
+  uint8_t  gprs;      // 1 while a bearer for apn is up
+  char     apn[32];
+
+  bool valid() const {
+    return magic == MAGIC;
+  }
+
+  // Forgets everything but the baud rate
+  void clear() {
+    uint32_t b = baud;
+    memset(this, 0, sizeof(*this));
+    baud = b;
+  }
+};
+
+// Waits for an "OK" at the rate the UART is at: 1 if it came, 0 if not, -1
+// if what came instead is mostly bytes no modem would send, i.e. the modem
+// talks at another rate
+template<class T>
+int TinyGsmAutoBaudWait(T& SerialAT, uint32_t rate)
+{
+  // Long enough for "AT\r\r\nOK\r\n" to come back at the rate, plus the
+  // modem's own reaction time
+  uint32_t wait_ms = 90000UL / rate + TINY_GSM_AUTOBAUD_WAIT_MS;
+  uint16_t garbled = 0;
+  uint16_t received = 0;
+  TinyGsmMatcher<1> match;
+  match.add(GF("OK\r\n"));
+  for (uint32_t start = millis(); millis() - start < wait_ms; ) {
+    if (SerialAT.available() <= 0) {
+      TINY_GSM_YIELD();
+      continue;
+    }
+    int c = SerialAT.read();
+    if (c < 0) continue;
+    received++;
+    if (match.feed(c)) return 1;
+    if ((c < 0x20 || c > 0x7E) && c != '\r' && c != '\n') garbled++;
+  }
+  return received >= 8 && garbled * 2 > received ? -1 : 0;
+}
+
+// Finds the baud rate the modem talks at.  Each rate gets a few "AT"s (some
+// modems need them to lock on to the rate), each with a short wait for the
+// "OK", and is given up on early if the answer comes back garbled.  The
+// rate that worked last time (e.g. TinyGsmWarmState::baud) is tried first.
+// With pin set, the modem is told to stay at the rate found (+IPR), instead
+// of auto-bauding again after its next reset.
 template<class T>
-uint32_t TinyGsmAutoBaud(T& SerialAT, uint32_t minimum = 9600, uint32_t maximum = 115200)
+uint32_t TinyGsmAutoBaud(T& SerialAT, uint32_t minimum = 9600, uint32_t maximum = 115200,
+                         uint32_t lastGood = 0, bool pin = false)
 {
   static uint32_t rates[] = { 115200, 57600, 38400, 19200, 9600, 74400, 74880, 230400, 460800, 2400, 4800, 14400, 28800 };
 
-  for (unsigned i = 0; i < sizeof(rates)/sizeof(rates[0]); i++) {
-    uint32_t rate = rates[i];
+  for (unsigned i = 0; i <= sizeof(rates)/sizeof(rates[0]); i++) {
+    uint32_t rate = i ? rates[i - 1] : lastGood;
     if (rate < minimum || rate > maximum) continue;
+    if (i && rate == lastGood) continue;  // Tried first
 
     DBG("Trying baud rate", rate, "...");
     SerialAT.begin(rate);
     delay(10);
-    for (int i=0; i<10; i++) {
+    while (SerialAT.available() > 0) SerialAT.read();
+    for (int t = 0; t < TINY_GSM_AUTOBAUD_TRIES; t++) {
       SerialAT.print("AT\r\n");
-      String input = SerialAT.readString();
-      if (input.indexOf("OK") >= 0) {
+      int res = TinyGsmAutoBaudWait(SerialAT, rate);
+      if (res < 0) {
+        DBG("Garbled at rate", rate);
+        break;
+      }
+      if (res > 0) {
         DBG("Modem responded at rate", rate);
+        if (pin) {
+          SerialAT.print("AT+IPR=");
+          SerialAT.print(rate);
+          SerialAT.print("\r\n");
+          TinyGsmAutoBaudWait(SerialAT, rate);
+        }
         return rate;
       }
     }
@@ -116,6 +892,58 @@ uint32_t TinyGsmAutoBaud(T& SerialAT, uint32_t minimum = 9600, uint32_t maximum
   return 0;
 }
 
+// True if count "AT"s in a row were answered with a clean "OK"
+template<class Modem>
+bool TinyGsmBaudCheck(Modem& modem, uint8_t count)
+{
+  for (uint8_t i = 0; i < count; i++) {
+    modem.sendAT(GF(""));
+    if (modem.waitResponse(200L) != 1) return false;
+  }
+  return true;
+}
+
+// Steps the modem and the host's UART up together, a standard rate at a
+// time, as long as the line stays clean, see negotiateBaud()
+template<class Modem, class T>
+uint32_t TinyGsmNegotiateBaud(Modem& modem, T& SerialAT, uint32_t current, uint32_t maxRate)
+{
+  static const uint32_t rates[] = { 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+
+  for (unsigned i = 0; i < sizeof(rates)/sizeof(rates[0]); i++) {
+    uint32_t rate = rates[i];
+    if (rate <= current) continue;
+    if (rate > maxRate) break;
+
+    modem.setBaud(rate);
+    if (modem.waitResponse() != 1) {
+      break;  // Not a rate the modem takes, it stays where it is
+    }
+    SerialAT.begin(rate);
+    delay(10);
+    if (TinyGsmBaudCheck(modem, TINY_GSM_BAUD_CHECKS)) {
+      DBG("### Baud rate:", rate);
+      current = rate;
+      continue;
+    }
+
+    // Not stable; keep asking for the rate that was, until it's back there
+    DBG("### Baud rate not stable:", rate);
+    for (int t = 0; t < 10; t++) {
+      SerialAT.begin(rate);
+      modem.setBaud(current);
+      modem.waitResponse(200L);
+      SerialAT.begin(current);
+      delay(10);
+      if (TinyGsmBaudCheck(modem, 3)) {
+        return current;
+      }
+    }
+    return 0;
+  }
+  return current;
+}
+
 static inline
 IPAddress TinyGsmIpFromString(const String& strIP) {
   int Parts[4] = {0, };
@@ -138,6 +966,12 @@ IPAddress TinyGsmIpFromString(const String& strIP) {
   return IPAddress(Parts[0], Parts[1], Parts[2], Parts[3]);
 }
 
+// Value of a hex digit, either case
+static inline
+uint8_t TinyGsmHexDigit(char c) {
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
 static inline
 String TinyGsmDecodeHex7bit(String &instr) {
   String result;
@@ -225,7 +1059,94 @@ String TinyGsmDecodeHex16bit(String &instr) {
   }
 
 
+// Follows a connect started with connectAsync(), which sends the command and
+// returns without waiting for the result.  poll() lets the modem handle what
+// it has sent in the meantime (the result comes as a URC) and gives up on the
+// connect once its timeout has passed.
+#define TINY_GSM_CLIENT_CONNECT_ASYNC() \
+  TinyGsmConnectState poll() { \
+    if (connect_state == CONNECT_PENDING) { \
+      at->maintain(); \
+    } \
+    if (connect_state == CONNECT_PENDING && \
+        millis() - connect_started > connect_timeout_ms) { \
+      DBG("### Connect timed out on", mux); \
+      stop(); \
+      connect_state = CONNECT_FAILED; \
+    } \
+    return connectState(); \
+  } \
+  \
+  TinyGsmConnectState connectState() const { \
+    return (TinyGsmConnectState)connect_state; \
+  }
+
+
 // Writes data out on the client using the modem send functionality
+#if TINY_GSM_TX_BUFFER
+// Small writes are collected in the tx buffer and sent together once it's
+// full, once it's been waiting TINY_GSM_TX_FLUSH_MS (checked on the next
+// write and in the modem's maintain()), on flush() or stop(), and before
+// reading or checking for data.
+// If the modem doesn't take it, write() returns 0 until stop(), and
+// writeFailed() says so.
+#define TINY_GSM_CLIENT_WRITE() \
+  virtual size_t write(const uint8_t *buf, size_t size) { \
+    TINY_GSM_YIELD(); \
+    if (tx.age() > TINY_GSM_TX_FLUSH_MS) { \
+      sendPending(); \
+    } \
+    if (tx.hasFailed()) return 0; \
+    if (!tx.length() && size >= TINY_GSM_TX_BUFFER) { \
+      at->maintain(); \
+      return at->modemSend(buf, size, mux); \
+    } \
+    size_t cnt = 0; \
+    while (cnt < size) { \
+      cnt += tx.append(buf + cnt, size - cnt); \
+      if (tx.full() && !sendPending()) { \
+        if (tx.hasFailed()) return 0; \
+        break; \
+      } \
+    } \
+    return cnt; \
+  } \
+  \
+  /* Sends whatever is waiting in the tx buffer.  Closing, it also forgets \
+     an earlier failure, for the next connection. */ \
+  bool sendPending(bool closing = false) { \
+    bool ok = true; \
+    if (tx.length()) { \
+      size_t sent = 0; \
+      if (sock_connected) { \
+        at->maintain(); \
+        sent = at->modemSend(tx.data(), tx.length(), mux); \
+      } \
+      ok = sent == tx.length(); \
+      if (!sent) { /* Dropped, the rest of a part sent is tried again */ \
+        DBG("### Buffered data not sent:", tx.length(), "bytes on", mux); \
+        tx.fail(); \
+      } \
+      tx.consume(sent ? sent : tx.length()); \
+    } \
+    if (closing) tx.clear(); \
+    return ok; \
+  } \
+  \
+  /* Buffered data was dropped as the modem didn't take it */ \
+  bool writeFailed() const { \
+    return tx.hasFailed(); \
+  } \
+  \
+  virtual size_t write(uint8_t c) {\
+    return write(&c, 1); \
+  }\
+  \
+  virtual size_t write(const char *str) { \
+    if (str == NULL) return 0; \
+    return write((const uint8_t *)str, strlen(str)); \
+  }
+#else
 #define TINY_GSM_CLIENT_WRITE() \
   virtual size_t write(const uint8_t *buf, size_t size) { \
     TINY_GSM_YIELD(); \
@@ -233,6 +1154,12 @@ String TinyGsmDecodeHex16bit(String &instr) {
     return at->modemSend(buf, size, mux); \
   } \
   \
+  bool sendPending(bool = false) { return true; } \
+  \
+  bool writeFailed() const { \
+    return false; \
+  } \
+  \
   virtual size_t write(uint8_t c) {\
     return write(&c, 1); \
   }\
@@ -241,6 +1168,7 @@ String TinyGsmDecodeHex16bit(String &instr) {
     if (str == NULL) return 0; \
     return write((const uint8_t *)str, strlen(str)); \
   }
+#endif
 
 
 // Returns the combined number of characters available in the TinyGSM fifo
@@ -248,18 +1176,41 @@ String TinyGsmDecodeHex16bit(String &instr) {
 // modem to see if anything has arrived without a UURC.
 #define TINY_GSM_CLIENT_AVAILABLE_WITH_BUFFER_CHECK() \
   virtual int available() { \
-    TINY_GSM_YIELD(); \
-    if (!rx.size()) { \
-      /* Workaround: sometimes module forgets to notify about data arrival.
-      TODO: Currently we ping the module periodically,
-      but maybe there's a better indicator that we need to poll */ \
-      if (millis() - prev_check > 500) { \
-        got_data = true; \
-        prev_check = millis(); \
-      } \
-      at->maintain(); \
+    sendPending(); \
+    if (!rx.size()) { /* Else there's nothing to ask the modem yet */ \
+      pollModem(); \
     } \
     return rx.size() + sock_available; \
+  } \
+  \
+  /* Data is waiting here or in the modem.  Once the socket is closed, data \
+     the modem announced but no one has asked about yet is asked about once; \
+     while it's open, nothing is sent to the modem. */ \
+  bool hasData() { \
+    if (!sock_connected && got_data && !rx.size() && sock_available <= 0) { \
+      at->maintain(); \
+      got_data = false; \
+    } \
+    return rx.size() || sock_available > 0; \
+  } \
+  \
+  /* Updates sock_available from the modem */ \
+  void pollModem() { \
+    TINY_GSM_YIELD(); \
+    /* Workaround: sometimes module forgets to notify about data arrival,
+    so check with it now and then, less often while the socket is idle */ \
+    bool check = !got_data && poll_check.due(); \
+    if (check) got_data = true; \
+    at->maintain(); \
+    if (check) poll_check.checked(sock_available > 0); \
+    if (sock_available) { \
+      poll_check.activity(); \
+    } \
+  } \
+  \
+  /* When and how often the socket checks for unannounced data */ \
+  TinyGsmPollScheduler& pollScheduler() { \
+    return poll_check; \
   }
 
 
@@ -267,11 +1218,28 @@ String TinyGsmDecodeHex16bit(String &instr) {
 // the modem chips internal fifo.  Use this if you don't expect to miss any URC's.
 #define TINY_GSM_CLIENT_AVAILABLE_NO_BUFFER_CHECK() \
   virtual int available() { \
-    TINY_GSM_YIELD(); \
+    sendPending(); \
     if (!rx.size()) { \
-      at->maintain(); \
+      pollModem(); \
     } \
     return rx.size() + sock_available; \
+  } \
+  \
+  /* Data is waiting here or in the modem.  Once the socket is closed, data \
+     the modem announced but no one has asked about yet is asked about once; \
+     while it's open, nothing is sent to the modem. */ \
+  bool hasData() { \
+    if (!sock_connected && got_data && !rx.size() && sock_available <= 0) { \
+      at->maintain(); \
+      got_data = false; \
+    } \
+    return rx.size() || sock_available > 0; \
+  } \
+  \
+  /* Updates sock_available from the modem */ \
+  void pollModem() { \
+    TINY_GSM_YIELD(); \
+    at->maintain(); \
   }
 
 
@@ -279,22 +1247,157 @@ String TinyGsmDecodeHex16bit(String &instr) {
 // Assumes the modem chip has no internal fifo
 #define TINY_GSM_CLIENT_AVAILABLE_NO_MODEM_FIFO() \
   virtual int available() { \
-    TINY_GSM_YIELD(); \
-    if (!rx.size() && sock_connected) { \
-      at->maintain(); \
+    sendPending(); \
+    if (!rx.size()) { \
+      pollModem(); \
     } \
     return rx.size(); \
+  } \
+  \
+  /* Data is waiting here */ \
+  bool hasData() { \
+    return rx.size() != 0; \
+  } \
+  \
+  /* Takes in whatever the modem has pushed for the socket, if there's room */ \
+  void pollModem() { \
+    if (sock_connected) { \
+      TINY_GSM_YIELD(); \
+      at->maintain(); \
+    } \
   }
 
 
+// Stream's find(), readBytesUntil() and readStringUntil(), working on the
+// fifo a block at a time with memchr() instead of a read() per character.
+// Like Stream's, they give up once nothing has come in for the time-out set
+// with setTimeout(), or the socket is closed with nothing more to come.
+#define TINY_GSM_CLIENT_READ_UNTIL() \
+  bool find(const uint8_t* target, size_t length) { \
+    if (!length) return true; \
+    uint32_t startMillis = millis(); \
+    for (;;) { \
+      size_t n; \
+      const uint8_t* p = rx.readSpan(n); \
+      const uint8_t* hit = p ? (const uint8_t*)memchr(p, target[0], n) : NULL; \
+      if (p && !hit) { \
+        rx.consume(n); /* Nothing that could start it */ \
+        continue; \
+      } \
+      if (hit) { \
+        rx.consume(hit - p); \
+        /* The candidate may run on past this block, or past the data so far */ \
+        size_t i = 1; \
+        uint8_t c; \
+        while (i < length && rx.peek(&c, i) && c == target[i]) i++; \
+        if (i == length) { \
+          rx.consume(length); \
+          return true; \
+        } \
+        if (i < rx.size() || !rx.free()) { \
+          rx.consume(1); \
+          continue; \
+        } \
+      } \
+      if (refill()) { \
+        startMillis = millis(); \
+      } else if (millis() - startMillis >= _timeout || \
+                 (!sock_connected && available() <= (int)rx.size())) { \
+        return false; \
+      } \
+    } \
+  } \
+  bool find(const char* target, size_t length) { \
+    return find((const uint8_t*)target, length); \
+  } \
+  bool find(const uint8_t* target) { \
+    return find(target, strlen((const char*)target)); \
+  } \
+  bool find(const char* target) { \
+    return find((const uint8_t*)target, strlen(target)); \
+  } \
+  bool find(char target) { \
+    return find((const uint8_t*)&target, 1); \
+  } \
+  \
+  size_t readBytesUntil(char terminator, char* buffer, size_t length) { \
+    size_t cnt = 0; \
+    uint32_t startMillis = millis(); \
+    while (cnt < length) { \
+      size_t n; \
+      const uint8_t* p = rx.readSpan(n); \
+      if (p) { \
+        n = TinyGsmMin(n, length - cnt); \
+        const uint8_t* hit = (const uint8_t*)memchr(p, terminator, n); \
+        if (hit) n = hit - p; \
+        memcpy(buffer + cnt, p, n); \
+        cnt += n; \
+        rx.consume(hit ? n + 1 : n); \
+        if (hit) break; \
+      } else if (refill()) { \
+        startMillis = millis(); \
+      } else if (millis() - startMillis >= _timeout || \
+                 (!sock_connected && available() <= (int)rx.size())) { \
+        break; \
+      } \
+    } \
+    return cnt; \
+  } \
+  size_t readBytesUntil(char terminator, uint8_t* buffer, size_t length) { \
+    return readBytesUntil(terminator, (char*)buffer, length); \
+  } \
+  \
+  String readStringUntil(char terminator) { \
+    String res; \
+    char buf[33]; \
+    for (;;) { \
+      size_t n = readBytesUntil(terminator, buf, sizeof(buf) - 1); \
+      buf[n] = '\0'; \
+      res += buf; \
+      if (n < sizeof(buf) - 1) break; \
+    } \
+    return res; \
+  }
+
+// read() and peek() for single characters.  While the fifo has any, they
+// come straight out of it without a trip to the modem, so reading byte by
+// byte (as MQTT and HTTP parsers do) costs no more than a bulk read.
 #define TINY_GSM_CLIENT_READ_OVERLOAD() \
   virtual int read() { \
+    uint8_t c = 0; \
+    sendPending(); \
+    if (rx.get(&c) || read(&c, 1) == 1) { \
+      return c; \
+    } \
+    return -1; \
+  } \
+  \
+  virtual int peek() { \
     uint8_t c; \
-    if (read(&c, 1) == 1) { \
+    sendPending(); \
+    if (rx.peek(&c) || (refill() && rx.peek(&c))) { \
       return c; \
     } \
     return -1; \
-  }
+  } \
+  \
+  /* Tops the fifo up from the modem's buffer, true if anything came in */ \
+  bool refill() { \
+    sendPending(); /* What's awaited may be the answer to it */ \
+    size_t had = rx.size(); \
+    TINY_GSM_READ_AHEAD_SETTLE(*at); \
+    if (rx.size() == had) { \
+      if (sock_available <= 0) { \
+        pollModem(); \
+      } \
+      if (sock_available > 0 && rx.free() > 0) { \
+        at->modemRead(TinyGsmMin((uint16_t)rx.free(), sock_available), mux); \
+      } \
+    } \
+    TINY_GSM_READ_AHEAD_NEXT(*at); \
+    return rx.size() > had; \
+  } \
+  TINY_GSM_CLIENT_READ_UNTIL()
 
 // Reads characters out of the TinyGSM fifo, and from the modem chips internal
 // fifo if avaiable, also double checking with the modem if data has arrived
@@ -302,8 +1405,10 @@ String TinyGsmDecodeHex16bit(String &instr) {
 #define TINY_GSM_CLIENT_READ_WITH_BUFFER_CHECK() \
   virtual int read(uint8_t *buf, size_t size) { \
     TINY_GSM_YIELD(); \
+    sendPending(); \
     at->maintain(); \
     size_t cnt = 0; \
+    bool direct = false; \
     while (cnt < size) { \
       size_t chunk = TinyGsmMin(size-cnt, rx.size()); \
       if (chunk > 0) { \
@@ -312,22 +1417,36 @@ String TinyGsmDecodeHex16bit(String &instr) {
         cnt += chunk; \
         continue; \
       } \
-      /* Workaround: sometimes module forgets to notify about data arrival.
-      TODO: Currently we ping the module periodically,
-      but maybe there's a better indicator that we need to poll */ \
-      if (millis() - prev_check > 500) { \
-        got_data = true; \
-        prev_check = millis(); \
-      } \
-      /* TODO: Read directly into user buffer? */ \
+      TINY_GSM_READ_AHEAD_SETTLE(*at); /* A chunk asked for before */ \
+      if (rx.size()) continue; \
+      /* Workaround: sometimes module forgets to notify about data arrival */ \
+      bool check = !got_data && poll_check.due(); \
+      if (check) got_data = true; \
       at->maintain(); \
-      if (sock_available > 0) { \
+      if (check) poll_check.checked(sock_available > 0); \
+      if (sock_available > 0 && size - cnt > (size_t)rx.free()) { \
+        /* More wanted than the fifo holds, read straight into the buffer */ \
+        size_t n = TinyGsmMin(size - cnt, (size_t)sock_available); \
+        n = at->modemRead(TinyGsmMin(n, (size_t)TINY_GSM_MAX_READ_CHUNK), mux, buf); \
+        if (n == 0) break; \
+        buf += n; \
+        cnt += n; \
+        direct = true; \
+      } else if (sock_available > 0) { \
         int n = at->modemRead(TinyGsmMin((uint16_t)rx.free(), sock_available), mux); \
         if (n == 0) break; \
       } else { \
         break; \
       } \
     } \
+    if (cnt) { \
+      poll_check.activity(); \
+    } \
+    if (cnt && !direct) { \
+      /* While the application works on this.  Not for reads big enough to \
+         go straight into the caller's buffer, that's cheaper. */ \
+      TINY_GSM_READ_AHEAD_NEXT(*at); \
+    } \
     return cnt; \
   } \
   TINY_GSM_CLIENT_READ_OVERLOAD()
@@ -338,6 +1457,7 @@ String TinyGsmDecodeHex16bit(String &instr) {
 #define TINY_GSM_CLIENT_READ_NO_BUFFER_CHECK() \
   virtual int read(uint8_t *buf, size_t size) { \
     TINY_GSM_YIELD(); \
+    sendPending(); \
     at->maintain(); \
     size_t cnt = 0; \
     while (cnt < size) { \
@@ -348,9 +1468,15 @@ String TinyGsmDecodeHex16bit(String &instr) {
         cnt += chunk; \
         continue; \
       } \
-      /* TODO: Read directly into user buffer? */ \
       at->maintain(); \
-      if (sock_available > 0) { \
+      if (sock_available > 0 && size - cnt > (size_t)rx.free()) { \
+        /* More wanted than the fifo holds, read straight into the buffer */ \
+        size_t n = TinyGsmMin(size - cnt, (size_t)sock_available); \
+        n = at->modemRead(TinyGsmMin(n, (size_t)TINY_GSM_MAX_READ_CHUNK), mux, buf); \
+        if (n == 0) break; \
+        buf += n; \
+        cnt += n; \
+      } else if (sock_available > 0) { \
         int n = at->modemRead(TinyGsmMin((uint16_t)rx.free(), sock_available), mux); \
         if (n == 0) break; \
       } else { \
@@ -368,6 +1494,7 @@ String TinyGsmDecodeHex16bit(String &instr) {
 #define TINY_GSM_CLIENT_READ_NO_MODEM_FIFO() \
   virtual int read(uint8_t *buf, size_t size) { \
     TINY_GSM_YIELD(); \
+    sendPending(); \
     size_t cnt = 0; \
     uint32_t _startMillis = millis(); \
     while (cnt < size && millis() - _startMillis < _timeout) { \
@@ -387,12 +1514,31 @@ String TinyGsmDecodeHex16bit(String &instr) {
   } \
   \
   virtual int read() { \
+    uint8_t c = 0; \
+    sendPending(); \
+    if (rx.get(&c) || read(&c, 1) == 1) { \
+      return c; \
+    } \
+    return -1; \
+  } \
+  \
+  virtual int peek() { \
     uint8_t c; \
-    if (read(&c, 1) == 1) { \
+    sendPending(); \
+    if (rx.peek(&c) || (refill() && rx.peek(&c))) { \
       return c; \
     } \
     return -1; \
-  }
+  } \
+  \
+  /* Takes in more of what the modem pushes, true if anything came in */ \
+  bool refill() { \
+    sendPending(); /* What's awaited may be the answer to it */ \
+    size_t had = rx.size(); \
+    pollModem(); \
+    return rx.size() > had; \
+  } \
+  TINY_GSM_CLIENT_READ_UNTIL()
 
 
 // Read and dump anything remaining in the modem's internal buffer.
@@ -403,6 +1549,7 @@ String TinyGsmDecodeHex16bit(String &instr) {
 // that it wants from the socket even if it was closed externally.
 #define TINY_GSM_CLIENT_DUMP_MODEM_BUFFER() \
     TINY_GSM_YIELD(); \
+    sendPending(true); \
     rx.clear(); \
     at->maintain(); \
     unsigned long startMillis = millis(); \
@@ -413,17 +1560,25 @@ String TinyGsmDecodeHex16bit(String &instr) {
     }
 
 
-// The peek, flush, and connected functions
-#define TINY_GSM_CLIENT_PEEK_FLUSH_CONNECTED() \
-  virtual int peek() { return -1; } /* TODO */ \
-  \
-  virtual void flush() { at->stream.flush(); } \
+// The flush and connected functions (peek() comes with read())
+#define TINY_GSM_CLIENT_FLUSH_CONNECTED() \
+  virtual void flush() { \
+    sendPending(); \
+    at->stream.flush(); \
+  } \
   \
+  /* Sends nothing to the modem while the socket is open: the driver keeps \
+     sock_connected up to date from the URC's, this only takes in any that \
+     have come.  A closed socket stays connected while it has data left to \
+     read, and until the modem has been asked once about data it announced. */ \
   virtual uint8_t connected() { \
-    if (available()) { \
-      return true; \
+    if (at->stream.available()) { \
+      TINY_GSM_READ_AHEAD_SETTLE(*at); /* Not left waiting after it */ \
     } \
-    return sock_connected; \
+    if (at->stream.available()) { \
+      at->waitResponse(15, NULL, NULL); \
+    } \
+    return sock_connected || hasData(); \
   } \
   virtual operator bool() { return connected(); }
 
@@ -432,6 +1587,77 @@ String TinyGsmDecodeHex16bit(String &instr) {
 #define TINY_GSM_MODEM_SET_BAUD_IPR() \
   void setBaud(unsigned long baud) { \
     sendAT(GF("+IPR="), baud); \
+  } \
+  TINY_GSM_MODEM_NEGOTIATE_BAUD()
+
+// Moves the modem and the host's UART (serial, at current now) to the
+// fastest rate up to maxRate at which the line stays clean, and returns that
+// rate.  If a rate turns out not to work, both go back to the one before;
+// 0 means the modem was lost on the way and needs TinyGsmAutoBaud().
+#define TINY_GSM_MODEM_NEGOTIATE_BAUD() \
+  template<class T> \
+  uint32_t negotiateBaud(T& serial, uint32_t current, uint32_t maxRate) { \
+    return TinyGsmNegotiateBaud(*this, serial, current, maxRate); \
+  }
+
+
+// Switches hardware flow control (RTS/CTS) on or off in the modem, see
+// TinyGsmFlowControl.  Needs the RTS and CTS lines wired up.
+#define TINY_GSM_MODEM_SET_FLOW_CONTROL_IFC() \
+  bool setFlowControl(bool hw, TinyGsmFlowControl::RtsHandler rts = NULL, \
+                      void* arg = NULL) { \
+    sendAT(GF("+IFC="), hw ? GF("2,2") : GF("0,0")); \
+    if (waitResponse() != 1) { \
+      return false; \
+    } \
+    flow.enable(hw, rts, arg); \
+    return true; \
+  }
+
+
+// Moves len bytes a modem pushed for a socket from the UART into its
+// buffer.  With flow control on, what doesn't fit stays in the UART, and
+// false is returned, unless drop is set: waitResponse() calls it again to
+// go on once there's room, and drops the rest if it needs to get past it to
+// an answer it's waiting for.  The socket is marked closed then, so the
+// application sees the loss.
+#define TINY_GSM_MODEM_PUSH_TO_SOCKET() \
+  bool pushToSocket(uint8_t mux, size_t len, bool drop) { \
+    GsmClient* sock = mux < TINY_GSM_MUX_COUNT ? sockets[mux] : NULL; \
+    size_t n = len; \
+    if (sock && flow.enabled() && !drop && n > (size_t)sock->rx.free()) { \
+      n = sock->rx.free(); \
+    } \
+    if (flow.holding() && (n || drop)) { \
+      flow.release(); /* Let the modem go on while there's room */ \
+    } \
+    if (!sock) { \
+      TinyGsmFifo<uint8_t, 1> none; /* Full, so everything is dropped */ \
+      streamReadToFifo(none, n, 1000); \
+      DBG("### Data for unknown socket:", len, "on", mux); \
+    } else if (n) { \
+      size_t got = streamReadToFifo(sock->rx, n, sock->_timeout); \
+      if (got < n && sock->rx.free()) { \
+        DBG("### Fewer characters received than expected:", got, "vs", n); \
+      } else if (got < n) { \
+        DBG("### Buffer overflow:", n - got, "bytes dropped on", mux); \
+        if (flow.enabled()) sock->sock_connected = false; \
+      } \
+    } \
+    if (n < len) { \
+      flow.hold(mux, len - n); \
+      return false; \
+    } \
+    return true; \
+  } \
+  \
+  bool pushHeld() { \
+    return flow.holding() && !pushToSocket(flow.mux, flow.left, false); \
+  } \
+  \
+  /* For a socket being closed */ \
+  void dropHeld(uint8_t mux) { \
+    if (flow.holding() && flow.mux == mux) pushToSocket(mux, flow.left, true); \
   }
 
 
@@ -447,10 +1673,36 @@ String TinyGsmDecodeHex16bit(String &instr) {
   }
 
 
+// Sends what has waited in a socket's tx buffer for longer than
+// TINY_GSM_TX_FLUSH_MS, so the last of what the application wrote goes out
+// from maintain() even if it stops writing.
+#if TINY_GSM_TX_BUFFER
+#define TINY_GSM_MODEM_SEND_STALE() \
+  void sendStale() { \
+    if (sendingStale) return;  /* sendPending() runs maintain() too */ \
+    sendingStale = true; \
+    for (int mux = 0; mux < TINY_GSM_MUX_COUNT; mux++) { \
+      GsmClient* sock = sockets[mux]; \
+      if (sock && sock->tx.age() > TINY_GSM_TX_FLUSH_MS) { \
+        sock->sendPending(); \
+      } \
+    } \
+    sendingStale = false; \
+  }
+#else
+#define TINY_GSM_MODEM_SEND_STALE() \
+  void sendStale() {}
+#endif
+
+
 // Keeps listening for modem URC's and iterates through sockets
-// to see if any data is avaiable
+// to see if any data is avaiable.  Needs one of the
+// TINY_GSM_MODEM_RECONCILE_SOCKS macros.
 #define TINY_GSM_MODEM_MAINTAIN_CHECK_SOCKS() \
+  TINY_GSM_MODEM_SEND_STALE() \
+  \
   void maintain() { \
+    sendStale(); \
     for (int mux = 0; mux < TINY_GSM_MUX_COUNT; mux++) { \
       GsmClient* sock = sockets[mux]; \
       if (sock && sock->got_data) { \
@@ -458,20 +1710,133 @@ String TinyGsmDecodeHex16bit(String &instr) {
         sock->sock_available = modemGetAvailable(mux); \
       } \
     } \
+    reconcileSockets(); \
+    if (stream.available()) { \
+      TINY_GSM_READ_AHEAD_SETTLE(*this); /* Not left waiting after it */ \
+    } \
     while (stream.available()) { \
       waitResponse(15, NULL, NULL); \
     } \
   }
 
 
+// Sockets are closed by URC's.  In case one got lost, reconcileSockets()
+// asks the modem about the sockets that still look open, every
+// TINY_GSM_RECONCILE_MS from maintain() or right away with force.
+#define TINY_GSM_MODEM_RECONCILE_SOCKS() \
+  void reconcileSockets(bool force = false) { \
+    if (!reconcileDue(force)) return; \
+    for (int mux = 0; mux < TINY_GSM_MUX_COUNT; mux++) { \
+      GsmClient* sock = sockets[mux]; \
+      if (sock && sock->sock_connected) { \
+        sock->sock_connected = modemGetConnected(mux); \
+      } \
+    } \
+  } \
+  TINY_GSM_MODEM_RECONCILE_DUE()
+
+
+// Like TINY_GSM_MODEM_RECONCILE_SOCKS, for modems whose modemGetConnected()
+// reports on all sockets at once
+#define TINY_GSM_MODEM_RECONCILE_SOCKS_BATCHED() \
+  void reconcileSockets(bool force = false) { \
+    if (!reconcileDue(force)) return; \
+    for (int mux = 0; mux < TINY_GSM_MUX_COUNT; mux++) { \
+      GsmClient* sock = sockets[mux]; \
+      if (sock && sock->sock_connected) { \
+        modemGetConnected(mux); \
+        break; \
+      } \
+    } \
+  } \
+  TINY_GSM_MODEM_RECONCILE_DUE()
+
+
+#define TINY_GSM_MODEM_RECONCILE_DUE() \
+  bool reconcileDue(bool force) { \
+    if (force) { \
+      reconcile.restart(); \
+      return true; \
+    } \
+    return reconcile.due(TINY_GSM_RECONCILE_MS); \
+  }
+
+
+// Keeps sock_available counting down from what the modem last said it had
+// (in a URC, or answering modemGetAvailable()) as modemRead() takes it out,
+// rather than asking again after every read.  Reads never ask for more than
+// the count, so it's only in doubt once a read comes back short or takes
+// the last of it; then the next maintain() asks.
+#define TINY_GSM_MODEM_READ_DONE() \
+  void modemReadDone(GsmClient* sock, size_t len, size_t size) { \
+    if (len == size && sock->sock_available > len) { \
+      sock->sock_available -= len; \
+    } else { \
+      sock->sock_available = 0; \
+      sock->got_data = true; \
+    } \
+  }
+
+
+// Sending reads ahead, see TinyGsmReadAhead.  The driver splits modemRead()
+// into modemReadAsk(), which only sends the command, and modemReadAnswer().
+#if TINY_GSM_READ_AHEAD
+#define TINY_GSM_MODEM_READ_AHEAD() \
+  /* Takes in the answer to the read sent ahead, if there's one out */ \
+  void readAheadSettle() { \
+    if (ahead.mux < 0) return; \
+    uint8_t mux = ahead.mux; \
+    ahead.mux = -1; \
+    if (!modemReadAnswer(ahead.size, mux) && sockets[mux]) { \
+      sockets[mux]->sock_available = 0;  /* Let maintain() ask, not again */ \
+      sockets[mux]->got_data = true; \
+    } \
+  } \
+  \
+  /* Asks for the next chunk of the first socket that has data waiting in \
+     the modem and room for it, without waiting for the answer */ \
+  void readAheadNext() { \
+    if (ahead.mux >= 0) return; \
+    for (int mux = 0; mux < TINY_GSM_MUX_COUNT; mux++) { \
+      GsmClient* sock = sockets[mux]; \
+      if (!sock || !sock->sock_available) continue; \
+      size_t size = TinyGsmMin((size_t)sock->sock_available, \
+                               (size_t)TINY_GSM_MODEM_READ_CHUNK); \
+      if ((size_t)sock->rx.free() < size) continue; \
+      modemReadAsk(size, mux); \
+      ahead.mux = mux; \
+      ahead.size = size; \
+      return; \
+    } \
+  }
+#else
+#define TINY_GSM_MODEM_READ_AHEAD()
+#endif
+
+
 // Keeps listening for modem URC's - doesn't check socks because
 // modem has no internal fifo
 #define TINY_GSM_MODEM_MAINTAIN_LISTEN() \
+  TINY_GSM_MODEM_SEND_STALE() \
+  \
   void maintain() { \
+    sendStale(); \
     waitResponse(100, NULL, NULL); \
   }
 
 
+// Lets the application handle URC's the driver doesn't know about.  They're
+// picked up whenever the driver reads from the modem, including maintain().
+#define TINY_GSM_MODEM_URC_HANDLERS() \
+  bool addUrcHandler(GsmConstStr prefix, TinyGsmUrcHandler handler, \
+                     void* arg = NULL) { \
+    return urcs.add(prefix, handler, arg); \
+  } \
+  bool removeUrcHandler(GsmConstStr prefix) { \
+    return urcs.remove(prefix); \
+  }
+
+
 // Asks for modem information via the V.25TER standard ATI command
 // NOTE:  The actual value and style of the response is quite varied
 #define TINY_GSM_MODEM_GET_INFO_ATI() \
@@ -503,9 +1868,8 @@ String TinyGsmDecodeHex16bit(String &instr) {
     if (waitResponse(GF(GSM_NL "+CCID:")) != 1) { \
       return ""; \
     } \
-    String res = stream.readStringUntil('\n'); \
+    String res = streamGetStringBefore('\n'); \
     waitResponse(); \
-    res.trim(); \
     return res; \
   }
 
@@ -517,9 +1881,8 @@ String TinyGsmDecodeHex16bit(String &instr) {
     if (waitResponse(GF(GSM_NL)) != 1) { \
       return ""; \
     } \
-    String res = stream.readStringUntil('\n'); \
+    String res = streamGetStringBefore('\n'); \
     waitResponse(); \
-    res.trim(); \
     return res; \
   }
 
@@ -535,7 +1898,7 @@ String TinyGsmDecodeHex16bit(String &instr) {
       return REG_UNKNOWN; \
     } \
     streamSkipUntil(','); /* Skip format (0) */ \
-    int status = stream.readStringUntil('\n').toInt(); \
+    int status = streamGetIntBefore('\n'); \
     waitResponse(); \
     return (RegStatus)status; \
   }
@@ -549,7 +1912,7 @@ String TinyGsmDecodeHex16bit(String &instr) {
       return ""; \
     } \
     streamSkipUntil('"'); /* Skip mode and format */ \
-    String res = stream.readStringUntil('"'); \
+    String res = streamGetStringBefore('"'); \
     waitResponse(); \
     return res; \
   }
@@ -575,7 +1938,7 @@ String TinyGsmDecodeHex16bit(String &instr) {
     if (waitResponse(GF(GSM_NL "+CGATT:")) != 1) { \
       return false; \
     } \
-    int res = stream.readStringUntil('\n').toInt(); \
+    int res = streamGetIntBefore('\n'); \
     waitResponse(); \
     if (res != 1) \
       return false; \
@@ -591,22 +1954,12 @@ String TinyGsmDecodeHex16bit(String &instr) {
     if (waitResponse(GF(GSM_NL "+CSQ:")) != 1) { \
       return 99; \
     } \
-    int res = stream.readStringUntil(',').toInt(); \
+    int res = streamGetIntBefore(','); \
     waitResponse(); \
     return res; \
   }
 
 
-// Yields up to a time-out period and then reads a character from the stream into the mux FIFO
-// TODO:  Do we need to wait two _timeout periods for no character return?  Will wait once in the first
-// "while !stream.available()" and then will wait again in the stream.read() function.
-#define TINY_GSM_MODEM_STREAM_TO_MUX_FIFO_WITH_DOUBLE_TIMEOUT \
-  uint32_t startMillis = millis(); \
-  while (!stream.available() && (millis() - startMillis < sockets[mux]->_timeout)) { TINY_GSM_YIELD(); } \
-  char c = stream.read(); \
-  sockets[mux]->rx.put(c);
-
-
 // Utility templates for writing/skipping characters on a stream
 #define TINY_GSM_MODEM_STREAM_UTILITIES() \
   template<typename T> \
@@ -622,6 +1975,11 @@ String TinyGsmDecodeHex16bit(String &instr) {
   \
   template<typename... Args> \
   void sendAT(Args... cmd) { \
+    TINY_GSM_READ_AHEAD_SETTLE(*this); /* Its answer comes first */ \
+    if (TINY_GSM_PUSH_HELD(*this)) { \
+      DBG("### Socket data held, command not sent"); \
+      return; \
+    } \
     streamWrite("AT", cmd..., GSM_NL); \
     stream.flush(); \
     TINY_GSM_YIELD(); \
@@ -639,6 +1997,126 @@ String TinyGsmDecodeHex16bit(String &instr) {
       } \
     } \
     return false; \
+  } \
+  \
+  /* Reads an integer up to (and consuming) lastChar without a String */ \
+  long streamGetIntBefore(char lastChar) { \
+    char buf[16]; \
+    size_t len = stream.readBytesUntil(lastChar, buf, sizeof(buf) - 1); \
+    if (len == sizeof(buf) - 1) { \
+      streamSkipUntil(lastChar); \
+    } \
+    buf[len] = '\0'; \
+    return atol(buf); \
+  } \
+  \
+  /* Reads a field up to (and consuming) lastChar into the response buffer, \
+     and makes the one String the caller gets out of it */ \
+  String streamGetStringBefore(char lastChar, \
+                               const unsigned long timeout_ms = 1000L) { \
+    response.clear(); \
+    unsigned long startMillis = millis(); \
+    while (millis() - startMillis < timeout_ms) { \
+      int c = stream.read(); \
+      if (c < 0) { \
+        TINY_GSM_YIELD(); \
+        continue; \
+      } \
+      if (c == lastChar) break; \
+      response.add(c); \
+    } \
+    response.trim(); \
+    return String(response.c_str()); \
+  } \
+  \
+  /* The text of the response waitResponse() just returned 1 for, without \
+     the final "OK" and the line breaks: short answers like +CIFSR's */ \
+  String responseBody() { \
+    const char* text = response.c_str(); \
+    uint16_t len = response.length(); \
+    const uint16_t ok = sizeof("OK" GSM_NL) - 1; \
+    if (len >= ok && !strcmp(text + len - ok, "OK" GSM_NL)) len -= ok; \
+    String res; \
+    res.reserve(len); \
+    for (uint16_t i = 0; i < len; i++) { \
+      if (text[i] != '\r' && text[i] != '\n') res += text[i]; \
+    } \
+    res.trim(); \
+    return res; \
+  } \
+  \
+  /* Moves len bytes of socket data from the stream straight into the free
+     space of a FIFO, a whole run at a time.  Gives up once nothing has come
+     in for timeout_ms.  Bytes that don't fit are read and dropped, to stay
+     in step with the modem.  Returns the number of bytes stored.
+     If direct is given the data goes there instead, it must fit len bytes. */ \
+  template<class F> \
+  size_t streamReadToFifo(F& fifo, size_t len, uint32_t timeout_ms, \
+                          uint8_t* direct = NULL) { \
+    size_t stored = 0; \
+    uint32_t startMillis = millis(); \
+    while (len) { \
+      size_t n = stream.available(); \
+      if (!n) { \
+        if (millis() - startMillis >= timeout_ms) break; \
+        TINY_GSM_YIELD(); \
+        continue; \
+      } \
+      if (n > len) n = len; \
+      size_t space = len; \
+      uint8_t* dst = direct ? direct + stored : fifo.writeSpan(space); \
+      if (dst) { \
+        if (n > space) n = space; \
+        n = stream.readBytes(dst, n); \
+        if (!direct) fifo.commit(n); \
+        stored += n; \
+      } else { \
+        stream.read(); \
+        n = 1; \
+      } \
+      if (n) { \
+        len -= n; \
+        startMillis = millis(); \
+      } \
+    } \
+    return stored; \
+  } \
+  \
+  /* The same for data the modem sends as two hex digits a byte, as \
+     +CIPRXGET in hex mode does.  len counts bytes, not digits. */ \
+  template<class F> \
+  size_t streamReadHexToFifo(F& fifo, size_t len, uint32_t timeout_ms, \
+                             uint8_t* direct = NULL) { \
+    size_t stored = 0; \
+    uint32_t startMillis = millis(); \
+    while (len) { \
+      size_t n = stream.available() / 2; \
+      if (!n) { \
+        if (millis() - startMillis >= timeout_ms) break; \
+        TINY_GSM_YIELD(); \
+        continue; \
+      } \
+      char hex[64]; \
+      if (n > sizeof(hex) / 2) n = sizeof(hex) / 2; \
+      if (n > len) n = len; \
+      size_t space = len; \
+      uint8_t* dst = direct ? direct + stored : fifo.writeSpan(space); \
+      if (dst && n > space) n = space; \
+      n = stream.readBytes(hex, n * 2) / 2; \
+      if (dst) { \
+        for (size_t i = 0; i < n; i++) { \
+          dst[i] = TinyGsmHexDigit(hex[2 * i]) << 4 | \
+                   TinyGsmHexDigit(hex[2 * i + 1]); \
+        } \
+        if (!direct) fifo.commit(n); \
+        stored += n; \
+      } \
+      if (n) { \
+        len -= n; \
+        startMillis = millis(); \
+      } \
+    } \
+    return stored; \
   }
 
 
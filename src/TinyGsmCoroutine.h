@@ -0,0 +1,261 @@
+/**
+ * @file       TinyGsmCoroutine.h
+ * @author     TinyGSM contributors
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2026 TinyGSM contributors
+ * @date       Oct 2026
+ */
+
+#ifndef TinyGsmCoroutine_h
+#define TinyGsmCoroutine_h
+
+#if __cplusplus < 202002L
+  #error "TinyGsmCoroutine.h needs C++20"
+#endif
+
+#include <coroutine>
+#include <TinyGsmCommandQueue.h>
+
+// Return type of a coroutine run by TinyGsmCoroutines.  It starts right
+// away, runs until its first co_await and frees itself when it returns.
+struct TinyGsmTask {
+  struct promise_type {
+    TinyGsmTask get_return_object() { return TinyGsmTask(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+};
+
+// What a queued AT command came back with, see TinyGsmCommandDone
+struct TinyGsmCommandResult {
+  uint8_t result;
+  String  text;
+};
+
+// Lets any number of coroutines share one modem on one thread:
+//
+//   TinyGsmCoroutines<TinyGsm, 256> gsm(modem, pump);
+//
+//   TinyGsmTask download(TinyGsmClient& client) {
+//     if (!co_await gsm.connect(client, "example.com", 80)) co_return;
+//     client.print("GET / HTTP/1.0\r\n\r\n");
+//     uint8_t buf[64];
+//     while (int n = co_await gsm.readSome(client, buf, sizeof(buf))) {
+//       ...
+//     }
+//   }
+//
+//   TinyGsmTask signal() {
+//     for (;;) {
+//       TinyGsmCommandResult csq = co_await gsm.command(GF("+CSQ"));
+//       ...
+//       co_await gsm.sleep(10000);
+//     }
+//   }
+//
+//   // in loop():
+//   gsm.tick();
+//
+// A coroutine waits in co_await until tick() finds what it's waiting for.
+// AT commands go through a TinyGsmCommandQueue; waits that talk to the
+// modem themselves (connect, readSome) are checked only while the queue
+// has no command out, so the two never mix on the UART.
+template<class Modem, uint16_t N, uint8_t Q = 4>
+class TinyGsmCoroutines
+{
+public:
+  // Something a coroutine waits for; tick() resumes it once ready() is true
+  class Wait {
+  public:
+    Wait(TinyGsmCoroutines& owner) : owner(owner), next(NULL) {}
+    virtual ~Wait() {}
+
+    bool await_ready() {
+      return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+      handle = h;
+      owner.park(this);
+    }
+
+  protected:
+    friend class TinyGsmCoroutines;
+
+    virtual bool ready() = 0;
+
+    TinyGsmCoroutines&      owner;
+    std::coroutine_handle<> handle;
+    Wait*                   next;
+  };
+
+  class SleepWait : public Wait {
+  public:
+    SleepWait(TinyGsmCoroutines& owner, uint32_t ms)
+      : Wait(owner), start(millis()), ms(ms) {}
+    void await_resume() {}
+  protected:
+    virtual bool ready() {
+      return millis() - start >= ms;
+    }
+    uint32_t start;
+    uint32_t ms;
+  };
+
+  class CommandWait : public Wait {
+  public:
+    CommandWait(TinyGsmCoroutines& owner, GsmConstStr cmd, uint32_t timeout_ms)
+      : Wait(owner), cmd(cmd), timeout_ms(timeout_ms), queued(false), done(false) {
+      res.result = 0;
+      // Too long for the queue: fails at once rather than waiting for room
+      if (GSM_STR_LEN(cmd) >= TINY_GSM_QUEUE_CMD_LEN) {
+        DBG("### Command too long to queue");
+        done = true;
+      }
+    }
+    TinyGsmCommandResult await_resume() {
+      return res;
+    }
+  protected:
+    virtual bool ready() {
+      if (!queued && !done) {
+        queued = this->owner.queue.add(cmd, finished, this, timeout_ms);
+      }
+      return done;
+    }
+    static void finished(uint8_t result, const String& text, void* arg) {
+      CommandWait* self = static_cast<CommandWait*>(arg);
+      self->res.result = result;
+      self->res.text = text;
+      self->done = true;
+    }
+    GsmConstStr          cmd;
+    uint32_t             timeout_ms;
+    bool                 queued;
+    bool                 done;
+    TinyGsmCommandResult res;
+  };
+
+  template<class Client>
+  class ConnectWait : public Wait {
+  public:
+    ConnectWait(TinyGsmCoroutines& owner, Client& client, const char* host,
+                uint16_t port, int timeout_s)
+      : Wait(owner), client(client), host(host), port(port),
+        timeout_s(timeout_s), started(false), state(CONNECT_IDLE) {}
+    bool await_resume() {
+      return state == CONNECT_DONE;
+    }
+  protected:
+    virtual bool ready() {
+      if (!started) {
+        started = true;
+        client.connectAsync(host, port, timeout_s);
+      }
+      state = client.poll();
+      return state != CONNECT_PENDING;
+    }
+    Client&             client;
+    const char*         host;
+    uint16_t            port;
+    int                 timeout_s;
+    bool                started;
+    TinyGsmConnectState state;
+  };
+
+  template<class Client>
+  class ReadWait : public Wait {
+  public:
+    ReadWait(TinyGsmCoroutines& owner, Client& client, uint8_t* buf, size_t size)
+      : Wait(owner), client(client), buf(buf), size(size), count(0) {}
+    int await_resume() {
+      return count;
+    }
+  protected:
+    virtual bool ready() {
+      if (client.available() > 0) {
+        count = client.read(buf, size);
+        return count > 0;
+      }
+      return !client.connected();
+    }
+    Client&  client;
+    uint8_t* buf;
+    size_t   size;
+    int      count;
+  };
+
+  TinyGsmCoroutines(Modem& modem, TinyGsmRxPump<N>& pump)
+    : queue(modem, pump)
+    , first(NULL)
+    , last(NULL)
+  {}
+
+  // Resumes after ms milliseconds
+  SleepWait sleep(uint32_t ms) {
+    return SleepWait(*this, ms);
+  }
+
+  // Sends an AT command (without the "AT") and resumes with the response.
+  // A command of TINY_GSM_QUEUE_CMD_LEN characters or more resumes with
+  // result 0 without being sent.
+  CommandWait command(GsmConstStr cmd, uint32_t timeout_ms = 1000L) {
+    return CommandWait(*this, cmd, timeout_ms);
+  }
+
+  // Connects the client, resumes with true once it's connected or false if
+  // it failed or timed out.  Needs a client with connectAsync().
+  template<class Client>
+  ConnectWait<Client> connect(Client& client, const char* host, uint16_t port,
+                              int timeout_s = 75) {
+    return ConnectWait<Client>(*this, client, host, port, timeout_s);
+  }
+
+  // Resumes with what the client received, at most size bytes, once there's
+  // anything; 0 means the connection is closed
+  template<class Client>
+  ReadWait<Client> readSome(Client& client, uint8_t* buf, size_t size) {
+    return ReadWait<Client>(*this, client, buf, size);
+  }
+
+  // Drives the modem and resumes every coroutine whose wait is over
+  void tick() {
+    queue.tick();
+    Wait* w = first;
+    first = last = NULL;
+    while (w) {
+      Wait* next = w->next;
+      if (!queue.busy() && w->ready()) {
+        w->handle.resume();  // May park new waits, and free w
+      } else {
+        park(w);
+      }
+      w = next;
+    }
+  }
+
+  // True if no coroutine is waiting
+  bool idle() const {
+    return first == NULL;
+  }
+
+  TinyGsmCommandQueue<Modem, N, Q> queue;
+
+private:
+  void park(Wait* w) {
+    w->next = NULL;
+    if (last) {
+      last->next = w;
+    } else {
+      first = w;
+    }
+    last = w;
+  }
+
+  Wait* first;
+  Wait* last;
+};
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef TinyGsmFifo_h
 #define TinyGsmFifo_h
 
+// Ring buffer holding up to N-1 elements.
+// NOTE:  Power-of-two sizes are cheapest, the indices are then wrapped with a
+// mask instead of a division.  Other sizes still work.
 template <class T, unsigned N>
 class TinyGsmFifo
 {
@@ -26,20 +29,16 @@ public:
 
     int free(void)
     {
-        int s = _r - _w;
-        if (s <= 0)
-            s += N;
-        return s - 1;
+        return N - 1 - _used(_r, _w);
     }
 
     bool put(const T& c)
     {
-        int i = _w;
-        int j = i;
-        i = _inc(i);
+        unsigned w = _w;
+        unsigned i = _inc(w);
         if (i == _r) // !writeable()
             return false;
-        _b[j] = c;
+        _b[w] = c;
         _w = i;
         return true;
     }
@@ -49,26 +48,40 @@ public:
         int c = n;
         while (c)
         {
-            int f;
-            while ((f = free()) == 0) // wait for space
+            size_t f;
+            T* w;
+            while ((w = writeSpan(f)) == NULL) // wait for space
             {
                 if (!t) return n - c; // no more space and not blocking
                 /* nothing / just wait */;
             }
-            // check free space
-            if (c < f) f = c;
-            int w = _w;
-            int m = N - w;
-            // check wrap
-            if (f > m) f = m;
-            memcpy(&_b[w], p, f);
-            _w = _inc(w, f);
+            if ((size_t)c < f) f = c;
+            memcpy(w, p, f * sizeof(T));
+            commit(f);
             c -= f;
             p += f;
         }
         return n - c;
     }
 
+    // Gives the largest contiguous free block, to be filled in place and then
+    // handed over to the reader with commit().  Returns NULL (and 0) if full.
+    T* writeSpan(size_t& n)
+    {
+        unsigned w = _w;
+        unsigned r = _r;
+        if (w >= r)
+            n = N - w - (r == 0 ? 1 : 0);
+        else
+            n = r - w - 1;
+        return n ? &_b[w] : NULL;
+    }
+
+    void commit(size_t n)
+    {
+        _w = _inc(_w, n);
+    }
+
     // reading thread/context API
     // --------------------------------------------------------
 
@@ -79,15 +92,12 @@ public:
 
     size_t size(void)
     {
-        int s = _w - _r;
-        if (s < 0)
-            s += N;
-        return s;
+        return _used(_r, _w);
     }
 
     bool get(T* p)
     {
-        int r = _r;
+        unsigned r = _r;
         if (r == _w) // !readable()
             return false;
         *p = _b[r];
@@ -100,37 +110,61 @@ public:
         int c = n;
         while (c)
         {
-            int f;
-            for (;;) // wait for data
+            size_t f;
+            const T* r;
+            while ((r = readSpan(f)) == NULL) // wait for data
             {
-                f = size();
-                if (f)  break;        // free space
-                if (!t) return n - c; // no space and not blocking
+                if (!t) return n - c; // no data and not blocking
                 /* nothing / just wait */;
             }
-            // check available data
-            if (c < f) f = c;
-            int r = _r;
-            int m = N - r;
-            // check wrap
-            if (f > m) f = m;
-            memcpy(p, &_b[r], f);
-            _r = _inc(r, f);
+            if ((size_t)c < f) f = c;
+            memcpy(p, r, f * sizeof(T));
+            consume(f);
             c -= f;
             p += f;
         }
         return n - c;
     }
 
+    // Gives the element i places from the front without taking it out.
+    // Returns false if there are no more than i elements.
+    bool peek(T* p, unsigned i = 0)
+    {
+        if (i >= size())
+            return false;
+        *p = _b[_inc(_r, i)];
+        return true;
+    }
+
+    // Gives the largest contiguous block of stored elements, to be parsed in
+    // place and then released with consume().  Returns NULL (and 0) if empty.
+    const T* readSpan(size_t& n)
+    {
+        unsigned r = _r;
+        unsigned w = _w;
+        n = (w >= r) ? w - r : N - r;
+        return n ? &_b[r] : NULL;
+    }
+
+    void consume(size_t n)
+    {
+        _r = _inc(_r, n);
+    }
+
 private:
-    int _inc(int i, int n = 1)
+    static unsigned _inc(unsigned i, unsigned n = 1)
+    {
+        return ((N & (N - 1)) == 0) ? ((i + n) & (N - 1)) : ((i + n) % N);
+    }
+
+    static unsigned _used(unsigned r, unsigned w)
     {
-        return (i + n) % N;
+        return ((N & (N - 1)) == 0) ? ((w - r) & (N - 1)) : ((w + N - r) % N);
     }
 
-    T    _b[N];
-    int  _w;
-    int  _r;
+    T         _b[N];
+    unsigned  _w;
+    unsigned  _r;
 };
 
 #endif
@@ -0,0 +1,223 @@
+/**
+ * @file       TinyGsmRxPump.h
+ * @author     TinyGSM contributors
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2026 TinyGSM contributors
+ * @date       Oct 2026
+ */
+
+#ifndef TinyGsmRxPump_h
+#define TinyGsmRxPump_h
+
+#include <TinyGsmCommon.h>
+
+// Index type of the pump's ring; one byte where that's enough, so the
+// interrupt and the main loop never see half-updated indices on 8-bit MCUs
+template<bool Small> struct TinyGsmRxPumpIndex { typedef uint16_t type; };
+template<> struct TinyGsmRxPumpIndex<true> { typedef uint8_t type; };
+
+// Sits between the modem's UART and the driver, and keeps draining the UART
+// into a ring of N bytes (a power of two) whenever poll() is called - also
+// between AT commands, when nothing in the driver reads from the modem.  At
+// high baud rates this keeps the UART's own small buffer from overflowing
+// and losing socket data and URC's.
+//
+//   TinyGsmRxPump<512> pump(SerialAT);
+//   TinyGsm modem(pump);
+//   ...
+//   // from a timer interrupt or a frequently run task:
+//   pump.poll();
+//
+// poll() may interrupt the driver reading from the other end of the ring (a
+// single producer / single consumer ring, no locks).  The driver calls it
+// too whenever the ring runs empty; a poll() interrupting another poll()
+// returns right away.  Only call it from an interrupt where the UART's
+// available()/read() are safe to use.
+template<uint16_t N>
+class TinyGsmRxPump : public Stream
+{
+#if defined(__AVR__)
+  static_assert(N <= 128, "TinyGsmRxPump: at most 128 bytes on AVR");
+#endif
+  static_assert(N && (N & (N - 1)) == 0, "TinyGsmRxPump: N must be a power of two");
+
+  typedef typename TinyGsmRxPumpIndex<(N <= 128)>::type Index;
+
+public:
+  explicit TinyGsmRxPump(Stream& stream)
+    : stream(stream)
+    , head(0)
+    , tail(0)
+    , fence(0)
+    , busy(false)
+    , full(false)
+    , fenced(false)
+  {}
+
+  // Moves what the UART has received into the ring
+  void poll() {
+    if (busy) return;
+    busy = true;
+    Index h = head;
+    while ((Index)(h - tail) < N && stream.available() > 0) {
+      int c = stream.read();
+      if (c < 0) break;
+      buf[h & (N - 1)] = c;
+      barrier();  // Byte stored before it's published
+      head = ++h;
+    }
+    if ((Index)(h - tail) >= N) full = true;
+    busy = false;
+  }
+
+  // True if the ring has filled up since the last call, i.e. the driver isn't
+  // keeping up and data may have been lost in the UART
+  bool overflowed() {
+    bool res = full;
+    full = false;
+    return res;
+  }
+
+  // Looks through the whole lines waiting in the ring for one that is one of
+  // the texts given (without the line end), or starts with it if the text
+  // ends with ':'.  For the first such line, fences the ring at its end (see
+  // fenceLines()) and returns which text it is (1-3).  Returns 0, and changes
+  // nothing, if there's no such line yet.
+  uint8_t fenceAtLine(GsmConstStr l1, GsmConstStr l2 = NULL,
+                      GsmConstStr l3 = NULL) {
+    poll();
+    GsmConstStr lines[3] = { l1, l2, l3 };
+    Index h = head;
+    Index start = tail;
+    for (Index t = tail; t != h; t++) {
+      if (buf[t & (N - 1)] != '\n') continue;
+      Index end = t;  // Without the line end
+      if (end != start && buf[(Index)(end - 1) & (N - 1)] == '\r') end--;
+      for (uint8_t i = 0; i < 3; i++) {
+        if (lines[i] && lineIs(start, end, lines[i])) {
+          fence = t + 1;
+          fenced = true;
+          return i + 1;
+        }
+      }
+      start = t + 1;
+    }
+    return 0;
+  }
+
+  // Shows the driver only the text waiting now, up to the end of its last
+  // whole line that isn't empty: available() counts down to there, says 0
+  // there once, then goes on past it.  A waitResponse() taking in what's
+  // available stops at the end of the line, not part way through the next
+  // one still arriving; an empty line is left for later, as it may start a
+  // URC ("\r\n+QIOPEN: ...") whose pattern takes in the line break.  A URC
+  // handler that waits for more data after the line still gets it.
+  // Returns false, and changes nothing, if there's no such line waiting.
+  bool fenceLines() {
+    poll();
+    Index h = head;
+    Index start = tail;
+    Index end = tail;
+    for (Index t = tail; t != h; t++) {
+      if (buf[t & (N - 1)] != '\n') continue;
+      Index n = t - start;  // Without the '\n'
+      if (n > 1 || (n == 1 && buf[start & (N - 1)] != '\r')) end = t + 1;
+      start = t + 1;
+    }
+    if (end == tail) return false;
+    fence = end;
+    fenced = true;
+    return true;
+  }
+
+  // Appends the text up to the fence to s, leaving it in the ring
+  void peekFenced(String& s) {
+    if (!fenced) return;
+    for (Index t = tail; t != fence; t++) {
+      s += (char)buf[t & (N - 1)];
+    }
+  }
+
+  void unfence() {
+    fenced = false;
+  }
+
+  /*
+   * Stream, used by the driver
+   */
+
+  virtual int available() {
+    poll();
+    Index n = head - tail;
+    if (fenced) {
+      Index left = fence - tail;
+      if (left && left <= n) return left;
+      fenced = false;  // At the fence, or read past it
+      if (!left) return 0;
+    }
+    return n;
+  }
+
+  virtual int read() {
+    if (head == tail) {
+      poll();
+      if (head == tail) return -1;
+    }
+    Index t = tail;
+    uint8_t c = buf[t & (N - 1)];
+    barrier();  // Byte taken before its slot is handed back
+    tail = t + 1;
+    return c;
+  }
+
+  virtual int peek() {
+    if (head == tail) {
+      poll();
+      if (head == tail) return -1;
+    }
+    return buf[tail & (N - 1)];
+  }
+
+  virtual size_t write(uint8_t c) {
+    return stream.write(c);
+  }
+
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    return stream.write(buffer, size);
+  }
+
+  virtual void flush() {
+    stream.flush();
+  }
+
+  using Print::write;
+
+private:
+  // True if the text from start to end is the line given, or starts with it
+  // if it ends with ':'
+  bool lineIs(Index start, Index end, GsmConstStr line) {
+    size_t len = GSM_STR_LEN(line);
+    bool prefix = len && GSM_STR_CHAR(line, len - 1) == ':';
+    Index n = end - start;
+    if (n < len || (n > len && !prefix)) return false;
+    for (size_t i = 0; i < len; i++) {
+      if (buf[(Index)(start + i) & (N - 1)] != GSM_STR_CHAR(line, i)) return false;
+    }
+    return true;
+  }
+
+  static inline void barrier() {
+    __asm__ __volatile__("" ::: "memory");
+  }
+
+  Stream&        stream;
+  uint8_t        buf[N];
+  volatile Index head;  // Written by poll() only
+  volatile Index tail;  // Written by the reader only
+  Index          fence;
+  volatile bool  busy;
+  volatile bool  full;
+  bool           fenced;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file       Arduino.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Nov 2016
+ *
+ * Just enough of the Arduino core to build TinyGSM on a Linux host.
+ * Time is simulated, see HostSim.h.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define DEC 10
+#define HEX 16
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int  digitalRead(uint8_t) { return LOW; }
+
+inline bool isDigit(int c) { return isdigit(c) != 0; }
+inline bool isSpace(int c) { return isspace(c) != 0; }
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Strings live in RAM on the host, so F() is a no-op
+class __FlashStringHelper;
+#define F(x) x
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+
+#endif
@@ -0,0 +1,756 @@
+/**
+ * @file       HostSim.cpp
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Nov 2016
+ */
+
+#include "HostSim.h"
+
+#include <time.h>
+
+/*
+ * Simulated clock and Arduino time functions
+ */
+
+static uint64_t clockUs = 0;
+
+uint64_t HostSim::now() { return clockUs; }
+void HostSim::advance(uint64_t us) { clockUs += us; }
+
+uint64_t HostSim::cpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Reading the clock costs a little time, so loops that spin on millis()
+// alone (without touching the modem) still run out eventually
+unsigned long millis() { return ++clockUs / 1000; }
+unsigned long micros() { return ++clockUs; }
+void delay(unsigned long ms) { clockUs += (uint64_t)ms * 1000; }
+void yield() {}
+
+HostSerial Serial;
+
+HostSim::HeapStats HostSim::stringHeap = { 0, 0 };
+
+/*
+ * Helpers
+ */
+
+static std::vector<std::string> splitArgs(const std::string& args) {
+  std::vector<std::string> res;
+  std::string cur;
+  bool quoted = false;
+  for (size_t i = 0; i < args.size(); i++) {
+    char c = args[i];
+    if (c == '"') {
+      quoted = !quoted;
+    } else if (c == ',' && !quoted) {
+      res.push_back(cur);
+      cur.clear();
+    } else {
+      cur += c;
+    }
+  }
+  res.push_back(cur);
+  return res;
+}
+
+static bool startsWith(const std::string& s, const char* prefix) {
+  return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Arguments after "<prefix>", e.g. "+CIPSEND=" -> ["1", "20"]
+static std::vector<std::string> argsOf(const std::string& cmd, const char* prefix) {
+  return splitArgs(cmd.substr(strlen(prefix)));
+}
+
+static int argInt(const std::vector<std::string>& args, size_t i) {
+  return i < args.size() ? atoi(args[i].c_str()) : 0;
+}
+
+static std::string num(long v) {
+  char b[24];
+  snprintf(b, sizeof(b), "%ld", v);
+  return b;
+}
+
+/*
+ * ModemSim
+ */
+
+ModemSim::ModemSim(Dialect dialect, uint32_t baud)
+  : dialect(dialect)
+  , hostBaud(baud)
+  , modemBaud(baud)
+  , latencyUs(2000)
+  , connectUs(200000)
+  , refuseAll(false)
+  , maxRead(dialect == UBLOX ? 1024 : 1460)
+  , bufferSize(8192)
+  , netRate(0)
+  , fragChunk(0)
+  , fragGapUs(0)
+  , rng(1)
+  , errorBaud(0)
+  , errorPerMille(0)
+  , uartSize(0)
+  , rtsCts(false)
+  , trace(false)
+  , inUart(0)
+  , stallUs(0)
+  , lineFreeOut(0)
+  , lineFreeIn(0)
+  , lastCr(false)
+  , sendMux(-1)
+  , sendLeft(0)
+{
+  for (uint8_t i = 0; i < MUX_COUNT; i++) {
+    socks[i].connected = false;
+    socks[i].notified = false;
+    socks[i].closing = false;
+    socks[i].netUs = 0;
+  }
+  resetStats();
+}
+
+void ModemSim::setFragmentation(uint16_t maxChunk, uint32_t gapUs, uint32_t seed) {
+  fragChunk = maxChunk;
+  fragGapUs = gapUs;
+  rng = seed ? seed : 1;
+}
+
+void ModemSim::resetStats() {
+  counters.commands = 0;
+  counters.bytesToHost = 0;
+  counters.bytesFromHost = 0;
+  counters.bytesLost = 0;
+  counters.cpuNs = 0;
+}
+
+// A modem baud rate of 0 means it's auto-bauding and follows the host
+bool ModemSim::baudMatches() const {
+  return modemBaud == 0 || modemBaud == hostBaud;
+}
+
+// True if the line garbles the next byte at this rate
+bool ModemSim::lineError(uint32_t baud) {
+  if (!errorBaud || baud <= errorBaud) return false;
+  rng = rng * 1103515245 + 12345;
+  return (rng >> 16) % 1000 < errorPerMille;
+}
+
+uint64_t ModemSim::nextEvent() const {
+  uint64_t next = inUart < out.size() ? out[inUart].at + stallUs : UINT64_MAX;
+  for (size_t i = 0; i < later.size(); i++) {
+    if (later[i].at < next) next = later[i].at;
+  }
+  return next;
+}
+
+// Nothing to read, time passes until the next byte, but at most as long as
+// a poll of a real UART takes.  Polling the modem shouldn't cost the driver
+// more time than it would on hardware.
+void ModemSim::idle() {
+  uint64_t next = nextEvent();
+  uint64_t step = 10;
+  if (next > clockUs && next - clockUs < step) step = next - clockUs;
+  clockUs += step;
+}
+
+// Lets the network deliver what it could have by now
+void ModemSim::pump() {
+  for (size_t i = 0; i < later.size(); ) {
+    if (later[i].at <= clockUs) {
+      emit(later[i].text);
+      later.erase(later.begin() + i);
+    } else {
+      i++;
+    }
+  }
+  arrive();
+  if (!netRate) return;
+  for (uint8_t mux = 0; mux < MUX_COUNT; mux++) {
+    Socket& s = socks[mux];
+    if (s.net.empty()) continue;
+    uint64_t budget = (clockUs - s.netUs) * netRate / 1000000;
+    size_t segment = s.net.size() < 1460 ? s.net.size() : 1460;
+    if (budget < segment) continue;
+    size_t before = s.net.size();
+    uint64_t start = HostSim::cpuNs();
+    fill(mux, budget - budget % segment);
+    counters.cpuNs += HostSim::cpuNs() - start;
+    if (s.net.size() == before) {
+      s.netUs = clockUs;  // Modem buffer full, the sender has to wait
+    } else {
+      s.netUs += (uint64_t)(before - s.net.size()) * 1000000 / netRate;
+    }
+  }
+}
+
+// Moves what's come over the line by now into the host's UART.  If that's
+// full, the byte is lost; with flow control, the modem holds it and
+// everything after it back until there's room again.
+void ModemSim::arrive() {
+  while (inUart < out.size() && out[inUart].at + stallUs <= clockUs) {
+    if (!uartSize || inUart < uartSize) {
+      inUart++;
+    } else if (rtsCts) {
+      uint64_t stall = clockUs + 1 - out[inUart].at;
+      lineFreeOut += stall - stallUs;
+      stallUs = stall;
+      break;
+    } else {
+      out.erase(out.begin() + inUart);
+      counters.bytesLost++;
+    }
+  }
+  if (inUart == out.size()) {
+    stallUs = 0;
+  }
+}
+
+int ModemSim::available() {
+  pump();
+  if (!inUart) idle();
+  return inUart;
+}
+
+int ModemSim::read() {
+  pump();
+  if (!inUart) {
+    idle();
+    return -1;
+  }
+  uint8_t c = out.front().c;
+  out.pop_front();
+  inUart--;
+  counters.bytesToHost++;
+  if (trace) fputc(c, stdout);
+  return c;
+}
+
+int ModemSim::peek() {
+  pump();
+  if (!inUart) {
+    idle();
+    return -1;
+  }
+  return out.front().c;
+}
+
+size_t ModemSim::write(uint8_t c) {
+  counters.bytesFromHost++;
+  uint64_t start = lineFreeIn > clockUs ? lineFreeIn : clockUs;
+  lineFreeIn = start + byteTimeUs(hostBaud);
+  if (trace) fputc(c, stdout);
+  if (lineError(hostBaud)) c ^= 0x08;
+  if (baudMatches()) receive(c);
+  return 1;
+}
+
+size_t ModemSim::write(const uint8_t* buf, size_t size) {
+  for (size_t i = 0; i < size; i++) write(buf[i]);
+  return size;
+}
+
+// Like a UART, waits until everything written has gone out on the line
+void ModemSim::flush() {
+  if (lineFreeIn > clockUs) clockUs = lineFreeIn;
+}
+
+void ModemSim::emit(const std::string& text, uint64_t delayUs) {
+  uint64_t base = lineFreeIn > clockUs ? lineFreeIn : clockUs;
+  // Commands are worked through one at a time: the latency of an answer only
+  // starts once the answer before it has gone out
+  if (delayUs && base < lineFreeOut) base = lineFreeOut;
+  uint64_t t = base + delayUs;
+  if (t < lineFreeOut) t = lineFreeOut;
+  uint32_t rate = modemBaud ? modemBaud : hostBaud;
+  uint32_t bt = byteTimeUs(rate);
+  uint16_t chunkLeft = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (fragChunk) {
+      if (!chunkLeft) {
+        rng = rng * 1103515245 + 12345;
+        chunkLeft = 1 + (rng >> 16) % fragChunk;
+        if (fragGapUs) t += (rng >> 8) % fragGapUs;
+      }
+      chunkLeft--;
+    }
+    t += bt;
+    Byte b = { t - stallUs, (uint8_t)(lineError(rate) ? text[i] ^ 0x08 : text[i]) };
+    out.push_back(b);
+  }
+  lineFreeOut = t;
+}
+
+void ModemSim::emitLater(uint8_t mux, const std::string& text, uint64_t delayUs) {
+  Later l = { clockUs + delayUs, mux, text };
+  later.push_back(l);
+}
+
+void ModemSim::reply(const std::string& text) {
+  emit("\r\n" + text + "\r\n\r\nOK\r\n", latencyUs);
+}
+
+void ModemSim::ok() {
+  emit("\r\nOK\r\n", latencyUs);
+}
+
+void ModemSim::error() {
+  emit("\r\nERROR\r\n", latencyUs);
+}
+
+void ModemSim::receive(uint8_t c) {
+  if (sendMux >= 0) {
+    // The "\n" ending the command line isn't part of the payload
+    if (c == '\n' && lastCr && sendData.empty()) {
+      lastCr = false;
+      return;
+    }
+    lastCr = false;
+    sendData += (char)c;
+    if (--sendLeft == 0) {
+      uint64_t start = HostSim::cpuNs();
+      finishSend();
+      counters.cpuNs += HostSim::cpuNs() - start;
+    }
+    return;
+  }
+  lastCr = (c == '\r');
+  if (c == '\r') {
+    std::string cmd;
+    cmd.swap(line);
+    if (cmd.size() >= 2 && toupper(cmd[0]) == 'A' && toupper(cmd[1]) == 'T') {
+      uint64_t start = HostSim::cpuNs();
+      command(cmd.substr(2));
+      counters.cpuNs += HostSim::cpuNs() - start;
+    }
+  } else if (c != '\n') {
+    line += (char)c;
+  }
+}
+
+void ModemSim::command(const std::string& cmd) {
+  counters.commands++;
+  bool handled = false;
+  switch (dialect) {
+    case SIM800:  handled = commandSim800(cmd);  break;
+    case BG96:    handled = commandBg96(cmd);    break;
+    case UBLOX:   handled = commandUblox(cmd);   break;
+    case ESP8266: handled = commandEsp8266(cmd); break;
+  }
+  if (!handled && !commandGeneric(cmd)) {
+    ok();  // Anything else is accepted as a setting
+  }
+}
+
+bool ModemSim::commandGeneric(const std::string& cmd) {
+  static const char* const models[] = { "SIM800", "BG96", "SARA-U201", "ESP8266" };
+  if (cmd == "+CPIN?") {
+    reply("+CPIN: READY");
+  } else if (startsWith(cmd, "+CPIN=")) {
+    emit("\r\n+CME ERROR: 16\r\n", latencyUs);  // Incorrect password
+  } else if (cmd == "+CSQ") {
+    reply("+CSQ: 21,0");
+  } else if (cmd == "+CREG?" || cmd == "+CGREG?" || cmd == "+CEREG?") {
+    reply(cmd.substr(0, cmd.size() - 1) + ": 0,1");
+  } else if (cmd == "+COPS?") {
+    reply("+COPS: 0,0,\"HostSim\",7");
+  } else if (cmd == "+CGATT?") {
+    reply("+CGATT: 1");
+  } else if (cmd == "+GSN" || cmd == "+CGSN") {
+    reply("867000000000001");
+  } else if (cmd == "+CCID" || cmd == "+QCCID") {
+    reply(cmd + ": 89000000000000000001");
+  } else if (cmd == "+GMM" || cmd == "+CGMM") {
+    reply(models[dialect]);
+  } else if (cmd == "I" || cmd == "+GMR") {
+    reply(std::string("HostSim ") + models[dialect]);
+  } else if (cmd == "+IPR?") {
+    reply("+IPR: " + num(modemBaud));
+  } else if (startsWith(cmd, "+IPR=") || startsWith(cmd, "+UART_CUR=")) {
+    ok();
+    modemBaud = atoi(cmd.c_str() + cmd.find('=') + 1);
+    if (startsWith(cmd, "+UART_CUR=")) {
+      rtsCts = argInt(argsOf(cmd, "+UART_CUR="), 4) == 3;
+    }
+  } else if (cmd == "+UART_CUR?") {
+    reply("+UART_CUR:" + num(modemBaud) + ",8,1,0," + (rtsCts ? "3" : "0"));
+  } else if (startsWith(cmd, "+IFC=")) {
+    rtsCts = argInt(argsOf(cmd, "+IFC="), 0) == 2;
+    ok();
+  } else if (cmd == "+IFC?") {
+    reply(rtsCts ? "+IFC: 2,2" : "+IFC: 0,0");
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Sockets
+ */
+
+bool ModemSim::connect(uint8_t mux, const std::string& host) {
+  if (refuseAll) return false;
+  Socket& s = socks[mux];
+  s.connected = true;
+  s.notified = false;
+  s.closing = false;
+  s.host = host;
+  s.rx.clear();
+  s.net.clear();
+  return true;
+}
+
+void ModemSim::close(uint8_t mux) {
+  for (size_t i = 0; i < later.size(); ) {
+    if (later[i].mux == mux) {
+      later.erase(later.begin() + i);
+    } else {
+      i++;
+    }
+  }
+  socks[mux].connected = false;
+  socks[mux].notified = false;
+  socks[mux].closing = false;
+  socks[mux].net.clear();
+}
+
+void ModemSim::startSend(uint8_t mux, size_t len) {
+  sendData.clear();
+  if (!len) {
+    sendMux = mux;
+    finishSend();
+    return;
+  }
+  sendMux = mux;
+  sendLeft = len;
+}
+
+void ModemSim::finishSend() {
+  uint8_t mux = sendMux;
+  size_t len = sendData.size();
+  sendMux = -1;
+  switch (dialect) {
+    case SIM800:
+      emit("\r\nDATA ACCEPT:" + num(mux) + "," + num(len) + "\r\n", latencyUs);
+      break;
+    case BG96:
+      emit("\r\nSEND OK\r\n", latencyUs);
+      break;
+    case UBLOX:
+      reply("+USOWR: " + num(mux) + "," + num(len));
+      break;
+    case ESP8266:
+      emit("\r\nRecv " + num(len) + " bytes\r\n\r\nSEND OK\r\n", latencyUs);
+      break;
+  }
+  if (sendHandler && socks[mux].connected) {
+    std::string data;
+    data.swap(sendData);
+    sendHandler(*this, mux, data);
+  }
+}
+
+std::string ModemSim::take(uint8_t mux, size_t size) {
+  Socket& s = socks[mux];
+  if (size > maxRead) size = maxRead;
+  if (size > s.rx.size()) size = s.rx.size();
+  std::string data = s.rx.substr(0, size);
+  s.rx.erase(0, size);
+  if (s.rx.empty()) s.notified = false;
+  if (!netRate) fill(mux);
+  return data;
+}
+
+// Moves what fits from the network into the modem's buffer
+void ModemSim::fill(uint8_t mux, size_t limit) {
+  Socket& s = socks[mux];
+  size_t room = s.rx.size() < bufferSize ? bufferSize - s.rx.size() : 0;
+  if (dialect == ESP8266) room = s.net.size();
+  if (room > s.net.size()) room = s.net.size();
+  if (room > limit) room = limit;
+  if (room) {
+    s.rx.append(s.net, 0, room);
+    s.net.erase(0, room);
+    notify(mux);
+  }
+  if (s.closing && s.net.empty()) closed(mux);
+}
+
+// Tells the host there's data, the way each modem does
+void ModemSim::notify(uint8_t mux) {
+  Socket& s = socks[mux];
+  switch (dialect) {
+    case SIM800:  // Once, until the buffer has been emptied
+      if (!s.notified) emit("\r\n+CIPRXGET: 1," + num(mux) + "\r\n");
+      break;
+    case BG96:
+      emit("\r\n+QIURC: \"recv\"," + num(mux) + "\r\n");
+      break;
+    case UBLOX:
+      emit("\r\n+UUSORD: " + num(mux) + "," + num(s.rx.size()) + "\r\n");
+      break;
+    case ESP8266:  // No modem side buffer, everything is pushed right away
+      while (!s.rx.empty()) {
+        std::string chunk = s.rx.substr(0, 1460);
+        s.rx.erase(0, chunk.size());
+        emit("\r\n+IPD," + num(mux) + "," + num(chunk.size()) + ":" + chunk);
+      }
+      break;
+  }
+  s.notified = true;
+}
+
+void ModemSim::serverData(uint8_t mux, const std::string& data) {
+  if (mux >= MUX_COUNT || !socks[mux].connected || data.empty()) return;
+  Socket& s = socks[mux];
+  if (s.net.empty()) s.netUs = clockUs;
+  s.net += data;
+  if (!netRate) fill(mux);
+}
+
+void ModemSim::serverClose(uint8_t mux) {
+  if (mux >= MUX_COUNT || !socks[mux].connected) return;
+  socks[mux].closing = true;
+  fill(mux, netRate ? 0 : SIZE_MAX);
+}
+
+void ModemSim::closed(uint8_t mux) {
+  socks[mux].connected = false;
+  socks[mux].closing = false;
+  switch (dialect) {
+    case SIM800:  emit("\r\n" + num(mux) + ", CLOSED\r\n"); break;
+    case BG96:    emit("\r\n+QIURC: \"closed\"," + num(mux) + "\r\n"); break;
+    case UBLOX:   emit("\r\n+UUSOCL: " + num(mux) + "\r\n"); break;
+    case ESP8266: emit(num(mux) + ",CLOSED\r\n"); break;
+  }
+}
+
+void ModemSim::urc(const std::string& text) {
+  emit(text);
+}
+
+/*
+ * Dialects
+ */
+
+static const char* const HOST_IP = "10.0.0.2";
+
+bool ModemSim::commandSim800(const std::string& cmd) {
+  if (startsWith(cmd, "+CIFSR")) {
+    emit(std::string("\r\n") + HOST_IP + "\r\n", latencyUs);
+    if (cmd.find(";E0") != std::string::npos) ok();
+  } else if (cmd == "E0+GSN;+CPIN?") {  // The driver's warm start probe
+    emit("\r\n867000000000001\r\n\r\n+CPIN: READY\r\n\r\nOK\r\n", latencyUs);
+  } else if (cmd == "+CFUN=1,1") {
+    ok();
+    // Reboots and reports in, like a SIM800 at a fixed baud rate
+    emitLater(MUX_COUNT, "\r\nRDY\r\n\r\n+CFUN: 1\r\n\r\n+CPIN: READY\r\n", 1500000);
+  } else if (cmd == "+CIPSSL=?") {
+    reply("+CIPSSL: (0,1)");
+  } else if (startsWith(cmd, "+CIPSTART=")) {
+    std::vector<std::string> a = argsOf(cmd, "+CIPSTART=");
+    uint8_t mux = argInt(a, 0) % MUX_COUNT;
+    ok();
+    bool up = connect(mux, a.size() > 2 ? a[2] : "");
+    emitLater(mux, "\r\n" + num(mux) + (up ? ", CONNECT OK\r\n" : ", CONNECT FAIL\r\n"), connectUs);
+  } else if (startsWith(cmd, "+CIPSEND=")) {
+    std::vector<std::string> a = argsOf(cmd, "+CIPSEND=");
+    emit("\r\n> ", latencyUs);
+    startSend(argInt(a, 0) % MUX_COUNT, argInt(a, 1));
+  } else if (startsWith(cmd, "+CIPRXGET=2,") || startsWith(cmd, "+CIPRXGET=3,")) {
+    std::vector<std::string> a = argsOf(cmd, "+CIPRXGET=");
+    bool hex = argInt(a, 0) == 3;
+    uint8_t mux = argInt(a, 1) % MUX_COUNT;
+    // Sizes count data bytes either way, at most 730 in hex mode
+    size_t size = argInt(a, 2);
+    std::string data = take(mux, hex && size > 730 ? 730 : size);
+    if (hex) {
+      std::string h;
+      for (size_t i = 0; i < data.size(); i++) {
+        char b[3];
+        snprintf(b, sizeof(b), "%02X", (uint8_t)data[i]);
+        h += b;
+      }
+      data = h;
+    }
+    emit("\r\n+CIPRXGET: " + a[0] + "," + num(mux) + "," + num(hex ? data.size() / 2 : data.size()) +
+         "," + num(socks[mux].rx.size()) + "\r\n" + data + "\r\nOK\r\n", latencyUs);
+  } else if (startsWith(cmd, "+CIPRXGET=4,")) {
+    uint8_t mux = argInt(argsOf(cmd, "+CIPRXGET=4,"), 0) % MUX_COUNT;
+    reply("+CIPRXGET: 4," + num(mux) + "," + num(socks[mux].rx.size()));
+  } else if (startsWith(cmd, "+CIPSTATUS=")) {
+    uint8_t mux = argInt(argsOf(cmd, "+CIPSTATUS="), 0) % MUX_COUNT;
+    const Socket& s = socks[mux];
+    reply("+CIPSTATUS: " + num(mux) + ",0,\"TCP\",\"" + s.host + "\",\"80\",\"" +
+          (s.connected ? "CONNECTED" : (s.host.empty() ? "INITIAL" : "CLOSED")) + "\"");
+  } else if (cmd == "+CIPSTATUS") {
+    // OK first, then the overall state and a line for each of the six
+    // connections
+    std::string lines = "\r\nOK\r\n\r\nSTATE: IP PROCESSING\r\n\r\n";
+    for (uint8_t i = 0; i < 6; i++) {
+      const Socket& s = socks[i];
+      if (s.host.empty()) {
+        lines += "C: " + num(i) + ",,\"\",\"\",\"\",\"INITIAL\"\r\n";
+      } else {
+        lines += "C: " + num(i) + ",0,\"TCP\",\"" + s.host + "\",\"80\",\"" +
+                 (s.connected ? "CONNECTED" : "CLOSED") + "\"\r\n";
+      }
+    }
+    emit(lines, latencyUs);
+  } else if (startsWith(cmd, "+CIPCLOSE=")) {
+    uint8_t mux = argInt(argsOf(cmd, "+CIPCLOSE="), 0) % MUX_COUNT;
+    close(mux);
+    emit("\r\n" + num(mux) + ", CLOSE OK\r\n", latencyUs);
+  } else if (cmd == "+CIPSHUT") {
+    for (uint8_t i = 0; i < MUX_COUNT; i++) close(i);
+    emit("\r\nSHUT OK\r\n", latencyUs);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ModemSim::commandBg96(const std::string& cmd) {
+  if (startsWith(cmd, "+QIOPEN=")) {
+    std::vector<std::string> a = argsOf(cmd, "+QIOPEN=");
+    uint8_t mux = argInt(a, 1) % MUX_COUNT;
+    ok();
+    bool up = connect(mux, a.size() > 3 ? a[3] : "");
+    emitLater(mux, "\r\n+QIOPEN: " + num(mux) + (up ? ",0\r\n" : ",566\r\n"), connectUs);
+  } else if (startsWith(cmd, "+QISEND=")) {
+    std::vector<std::string> a = argsOf(cmd, "+QISEND=");
+    emit("\r\n> ", latencyUs);
+    startSend(argInt(a, 0) % MUX_COUNT, argInt(a, 1));
+  } else if (startsWith(cmd, "+QIRD=")) {
+    std::vector<std::string> a = argsOf(cmd, "+QIRD=");
+    uint8_t mux = argInt(a, 0) % MUX_COUNT;
+    if (a.size() > 1 && argInt(a, 1) == 0) {
+      size_t left = socks[mux].rx.size();
+      reply("+QIRD: " + num(left) + ",0," + num(left));
+    } else {
+      std::string data = take(mux, a.size() > 1 ? argInt(a, 1) : 1500);
+      emit("\r\n+QIRD: " + num(data.size()) + "\r\n" + data + "\r\n\r\nOK\r\n", latencyUs);
+    }
+  } else if (startsWith(cmd, "+QISTATE=1,")) {
+    uint8_t mux = argInt(argsOf(cmd, "+QISTATE=1,"), 0) % MUX_COUNT;
+    const Socket& s = socks[mux];
+    if (s.connected) {
+      reply("+QISTATE: " + num(mux) + ",\"TCP\",\"" + s.host + "\",80,4000,2,1," +
+            num(mux) + ",0,\"uart1\"");
+    } else {
+      ok();
+    }
+  } else if (cmd == "+QISTATE?") {
+    // Every connection that's still open, closed by the remote side or not
+    std::string lines;
+    for (uint8_t i = 0; i < MUX_COUNT; i++) {
+      const Socket& s = socks[i];
+      if (s.host.empty()) continue;
+      lines += "\r\n+QISTATE: " + num(i) + ",\"TCP\",\"" + s.host + "\",80,4000," +
+               (s.connected ? "2" : "4") + ",1," + num(i) + ",0,\"uart1\"";
+    }
+    emit(lines + "\r\n\r\nOK\r\n", latencyUs);
+  } else if (startsWith(cmd, "+QICLOSE=")) {
+    close(argInt(argsOf(cmd, "+QICLOSE="), 0) % MUX_COUNT);
+    ok();
+  } else if (cmd == "+QILOCIP" || startsWith(cmd, "+CGPADDR")) {
+    reply("+CGPADDR: 1," + std::string(HOST_IP));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ModemSim::commandUblox(const std::string& cmd) {
+  if (startsWith(cmd, "+USOCR=")) {
+    uint8_t mux = 0;
+    while (mux < MUX_COUNT - 1 && (socks[mux].connected || !socks[mux].host.empty())) mux++;
+    socks[mux].host = "?";  // Created, not connected yet
+    reply("+USOCR: " + num(mux));
+  } else if (startsWith(cmd, "+USOCO=")) {
+    std::vector<std::string> a = argsOf(cmd, "+USOCO=");
+    uint8_t mux = argInt(a, 0) % MUX_COUNT;
+    bool up = connect(mux, a.size() > 1 ? a[1] : "");
+    if (a.size() > 3 && argInt(a, 3) == 1) {
+      // Asynchronous connect, the result follows as a URC
+      ok();
+      emitLater(mux, "\r\n+UUSOCO: " + num(mux) + (up ? ",0\r\n" : ",111\r\n"), connectUs);
+    } else {
+      emit(up ? "\r\nOK\r\n" : "\r\nERROR\r\n", connectUs);
+    }
+  } else if (startsWith(cmd, "+USOWR=")) {
+    std::vector<std::string> a = argsOf(cmd, "+USOWR=");
+    emit("\r\n@", latencyUs);
+    startSend(argInt(a, 0) % MUX_COUNT, argInt(a, 1));
+  } else if (startsWith(cmd, "+USORD=")) {
+    std::vector<std::string> a = argsOf(cmd, "+USORD=");
+    uint8_t mux = argInt(a, 0) % MUX_COUNT;
+    if (argInt(a, 1) == 0) {
+      reply("+USORD: " + num(mux) + "," + num(socks[mux].rx.size()));
+    } else {
+      std::string data = take(mux, argInt(a, 1));
+      reply("+USORD: " + num(mux) + "," + num(data.size()) + ",\"" + data + "\"");
+    }
+  } else if (startsWith(cmd, "+USOCTL=")) {
+    uint8_t mux = argInt(argsOf(cmd, "+USOCTL="), 0) % MUX_COUNT;
+    reply("+USOCTL: " + num(mux) + ",10," + (socks[mux].connected ? "4" : "0"));
+  } else if (startsWith(cmd, "+USOCL=")) {
+    uint8_t mux = argInt(argsOf(cmd, "+USOCL="), 0) % MUX_COUNT;
+    close(mux);
+    socks[mux].host.clear();
+    ok();
+  } else if (cmd == "+UPSND=0,8") {
+    reply("+UPSND: 0,8,1");
+  } else if (cmd == "+UPSND=0,0") {
+    reply("+UPSND: 0,0,\"" + std::string(HOST_IP) + "\"");
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ModemSim::commandEsp8266(const std::string& cmd) {
+  if (cmd == "+CIPSTATUS") {
+    bool any = false;
+    std::string lines;
+    for (uint8_t i = 0; i < MUX_COUNT; i++) {
+      if (!socks[i].connected) continue;
+      any = true;
+      lines += "+CIPSTATUS:" + num(i) + ",\"TCP\",\"" + socks[i].host + "\",80,4000,0\r\n";
+    }
+    emit("\r\nSTATUS:" + std::string(any ? "3" : "2") + "\r\n" + lines + "\r\nOK\r\n", latencyUs);
+  } else if (startsWith(cmd, "+CWJAP_CUR=")) {
+    emit("\r\nWIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n", connectUs);
+  } else if (cmd == "+CWJAP_CUR?") {
+    reply("+CWJAP_CUR:\"HostSim\",\"00:00:00:00:00:00\",6,-60");
+  } else if (startsWith(cmd, "+CIPSTA_CUR?")) {
+    reply("+CIPSTA_CUR:ip:\"" + std::string(HOST_IP) + "\"");
+  } else if (startsWith(cmd, "+CIPSTART=")) {
+    std::vector<std::string> a = argsOf(cmd, "+CIPSTART=");
+    uint8_t mux = argInt(a, 0) % MUX_COUNT;
+    if (connect(mux, a.size() > 2 ? a[2] : "")) {
+      emit(num(mux) + ",CONNECT\r\n\r\nOK\r\n", connectUs);
+    } else {
+      emit("\r\nERROR\r\n", connectUs);
+    }
+  } else if (startsWith(cmd, "+CIPSEND=")) {
+    std::vector<std::string> a = argsOf(cmd, "+CIPSEND=");
+    emit("\r\nOK\r\n> ", latencyUs);
+    startSend(argInt(a, 0) % MUX_COUNT, argInt(a, 1));
+  } else if (startsWith(cmd, "+CIPCLOSE=")) {
+    uint8_t mux = argInt(argsOf(cmd, "+CIPCLOSE="), 0) % MUX_COUNT;
+    close(mux);
+    emit(num(mux) + ",CLOSED\r\n\r\nOK\r\n", latencyUs);
+  } else {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,238 @@
+/**
+ * @file       HostSim.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Nov 2016
+ *
+ * Host side harness for running TinyGSM drivers on Linux against a simulated
+ * modem, without hardware.
+ *
+ * Time is simulated.  millis()/micros() return the simulated clock, delay()
+ * advances it, and polling an empty ModemSim moves it on to the next byte the
+ * modem will deliver (or by at most 10us).  Transfers that take minutes on a
+ * real UART run in milliseconds, yet the timing the driver sees follows the
+ * configured baud rate exactly and is reproducible from run to run.
+ */
+
+#ifndef HostSim_h
+#define HostSim_h
+
+#include "Arduino.h"
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace HostSim {
+
+  // Simulated time in microseconds
+  uint64_t now();
+  void     advance(uint64_t us);
+
+  // Real CPU time used by this thread, in nanoseconds
+  uint64_t cpuNs();
+
+}  // namespace HostSim
+
+
+// Console stream, stands in for Serial (e.g. as TINY_GSM_DEBUG)
+class HostSerial : public Stream
+{
+public:
+  void begin(unsigned long) {}
+  void end() {}
+
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  virtual size_t write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+  virtual size_t write(const uint8_t* buf, size_t size) { return fwrite(buf, 1, size, stdout); }
+  using Print::write;
+  operator bool() { return true; }
+};
+
+extern HostSerial Serial;
+
+
+// A modem on the other end of a UART.  Drivers use it as their Stream; a
+// test or benchmark scripts the network side: data arriving on sockets,
+// connections closed remotely, arbitrary URCs.
+class ModemSim : public Stream
+{
+public:
+  enum Dialect {
+    SIM800,   // SIMCom, +CIPRXGET manual receive
+    BG96,     // Quectel, +QIRD
+    UBLOX,    // u-blox SARA/LISA, +USORD
+    ESP8266,  // Espressif AT firmware, data pushed with +IPD
+  };
+
+  static const uint8_t MUX_COUNT = 7;
+
+  explicit ModemSim(Dialect dialect, uint32_t baud = 115200);
+
+  // UART side, used by the driver
+  void begin(uint32_t baud) { hostBaud = baud; }
+  void end() {}
+
+  virtual int    available();
+  virtual int    read();
+  virtual int    peek();
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t* buf, size_t size);
+  virtual void   flush();
+  using Print::write;
+
+  // Configuration
+  void setModemBaud(uint32_t baud) { modemBaud = baud; }
+  uint32_t getModemBaud() const { return modemBaud; }
+  // Time between the end of a command and the start of its response
+  void setLatency(uint32_t us) { latencyUs = us; }
+  // Time from +CIPSTART/+QIOPEN/+USOCO to the connection being up
+  void setConnectTime(uint32_t us) { connectUs = us; }
+  // Makes every connection attempt fail, after the connect time
+  void refuseConnections(bool refuse) { refuseAll = refuse; }
+  // Deliver output in random chunks of up to maxChunk bytes, separated by
+  // gaps of up to gapUs, so lines and URCs arrive split up
+  void setFragmentation(uint16_t maxChunk, uint32_t gapUs, uint32_t seed = 1);
+  // Largest payload a single read command returns (modem limit)
+  void setMaxRead(uint16_t bytes) { maxRead = bytes; }
+  // Receive buffer of each socket in the modem; the rest of the data waits
+  // in the network until the driver reads some out
+  void setModemBuffer(uint32_t bytes) { bufferSize = bytes; }
+  // Network throughput per socket in bytes/s (0 = unlimited).  Data is
+  // delivered to the modem in segments of up to 1460 bytes.
+  void setNetworkRate(uint32_t bytesPerSec) { netRate = bytesPerSec; }
+  // Above this baud rate, the line corrupts about perMille bytes in 1000
+  // in each direction (0 = never)
+  void setLineErrors(uint32_t aboveBaud, uint16_t perMille) {
+    errorBaud = aboveBaud;
+    errorPerMille = perMille;
+  }
+  // Receive buffer of the host's UART (0 = unlimited).  What arrives while
+  // it's full is lost, unless RTS/CTS flow control is on (AT+IFC=2,2, or
+  // AT+UART_CUR=...,3 on the ESP8266): then the modem waits for room.
+  void setUartBuffer(size_t bytes) { uartSize = bytes; }
+  bool flowControl() const { return rtsCts; }
+  // Print everything crossing the UART to stdout
+  void setTrace(bool on) { trace = on; }
+
+  // Network side, used by the script
+  typedef std::function<void(ModemSim& modem, uint8_t mux,
+                             const std::string& data)> SendHandler;
+  // Called with whatever the driver sends on a socket
+  void onSend(SendHandler handler) { sendHandler = handler; }
+  // Data arriving from the remote end of a socket
+  void serverData(uint8_t mux, const std::string& data);
+  // Remote end closes the socket, once all data sent before has arrived
+  void serverClose(uint8_t mux);
+  // Raw unsolicited text, sent as is
+  void urc(const std::string& text);
+
+  bool isConnected(uint8_t mux) const { return socks[mux].connected; }
+  const std::string& host(uint8_t mux) const { return socks[mux].host; }
+  // Bytes sent by the remote end and not read by the driver yet
+  size_t pending(uint8_t mux) const { return socks[mux].rx.size() + socks[mux].net.size(); }
+
+  struct Stats {
+    uint32_t commands;
+    uint64_t bytesToHost;
+    uint64_t bytesFromHost;
+    uint64_t bytesLost;  // overran the host's UART buffer
+    uint64_t cpuNs;  // CPU time spent handling commands and network data
+  };
+  const Stats& stats() const { return counters; }
+  void resetStats();
+
+private:
+  struct Socket {
+    bool        connected;
+    bool        notified;
+    bool        closing;
+    std::string host;
+    std::string rx;   // in the modem's buffer
+    std::string net;  // still on its way
+    uint64_t    netUs;  // network delivery accounted for up to here
+  };
+
+  struct Byte {
+    uint64_t at;
+    uint8_t  c;
+  };
+
+  uint32_t byteTimeUs(uint32_t baud) const { return 10000000UL / baud; }
+  bool     baudMatches() const;
+  bool     lineError(uint32_t baud);
+  uint64_t nextEvent() const;
+  void     idle();
+  void     pump();
+  void     arrive();
+
+  void emit(const std::string& text, uint64_t delayUs = 0);
+  // Sends a URC once delayUs have passed, answering commands in the meantime
+  void emitLater(uint8_t mux, const std::string& text, uint64_t delayUs);
+  void reply(const std::string& text);
+  void ok();
+  void error();
+
+  void receive(uint8_t c);
+  void command(const std::string& cmd);
+  bool commandGeneric(const std::string& cmd);
+  bool commandSim800(const std::string& cmd);
+  bool commandBg96(const std::string& cmd);
+  bool commandUblox(const std::string& cmd);
+  bool commandEsp8266(const std::string& cmd);
+
+  bool connect(uint8_t mux, const std::string& args);
+  void close(uint8_t mux);
+  void startSend(uint8_t mux, size_t len);
+  void finishSend();
+  void fill(uint8_t mux, size_t limit = SIZE_MAX);
+  void notify(uint8_t mux);
+  void closed(uint8_t mux);
+  std::string take(uint8_t mux, size_t size);
+
+  Dialect     dialect;
+  uint32_t    hostBaud;
+  uint32_t    modemBaud;
+  uint32_t    latencyUs;
+  uint32_t    connectUs;
+  bool        refuseAll;
+  uint16_t    maxRead;
+  uint32_t    bufferSize;
+  uint32_t    netRate;
+  uint16_t    fragChunk;
+  uint32_t    fragGapUs;
+  uint32_t    rng;
+  uint32_t    errorBaud;
+  uint16_t    errorPerMille;
+  size_t      uartSize;
+  bool        rtsCts;
+  bool        trace;
+
+  struct Later {
+    uint64_t    at;
+    uint8_t     mux;
+    std::string text;
+  };
+
+  std::deque<Byte> out;       // modem -> host, with arrival times
+  size_t      inUart;         // bytes at the front of out that have arrived
+  uint64_t    stallUs;        // the rest comes this much later, see pump()
+  std::vector<Later> later;   // URCs still to come, see emitLater()
+  uint64_t    lineFreeOut;    // when the modem -> host line is idle again
+  uint64_t    lineFreeIn;     // when the host -> modem line is idle again
+  std::string line;           // command being received
+  bool        lastCr;
+  int         sendMux;        // socket a payload is being received for
+  size_t      sendLeft;
+  std::string sendData;
+
+  Socket      socks[MUX_COUNT];
+  SendHandler sendHandler;
+  Stats       counters;
+};
+
+#endif
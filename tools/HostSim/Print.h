@@ -0,0 +1,71 @@
+/**
+ * @file       Print.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Nov 2016
+ */
+
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "WString.h"
+#include "Printable.h"
+
+class Print
+{
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buf[n])) n++;
+    return n;
+  }
+  size_t write(const char* str) {
+    return str ? write((const uint8_t*)str, strlen(str)) : 0;
+  }
+  size_t write(const char* buf, size_t size) {
+    return write((const uint8_t*)buf, size);
+  }
+  virtual void flush() {}
+
+  size_t print(const String& s) { return write(s.c_str(), s.length()); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = 10) { return printNumber(v, false, base); }
+  size_t print(short v, int base = 10) { return print((long)v, base); }
+  size_t print(unsigned short v, int base = 10) { return printNumber(v, false, base); }
+  size_t print(int v, int base = 10) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = 10) { return printNumber(v, false, base); }
+  size_t print(long v, int base = 10) {
+    if (v < 0 && base == 10) return printNumber(-(unsigned long long)v, true, base);
+    return printNumber((unsigned long)v, false, base);
+  }
+  size_t print(unsigned long v, int base = 10) { return printNumber(v, false, base); }
+  size_t print(double v, int digits = 2) {
+    char b[48];
+    snprintf(b, sizeof(b), "%.*f", digits, v);
+    return write(b);
+  }
+  size_t print(const Printable& p) { return p.printTo(*this); }
+
+  size_t println() { return write("\r\n"); }
+  template<typename T>
+  size_t println(const T& v) { size_t n = print(v); return n + println(); }
+  template<typename T>
+  size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+private:
+  size_t printNumber(unsigned long long v, bool negative, int base) {
+    char b[48];
+    snprintf(b, sizeof(b), base == 16 ? "%s%llX" : "%s%llu", negative ? "-" : "", v);
+    return write(b);
+  }
+};
+
+#endif
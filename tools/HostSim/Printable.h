@@ -0,0 +1,23 @@
+/**
+ * @file       Printable.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Nov 2016
+ */
+
+#ifndef Printable_h
+#define Printable_h
+
+#include <stddef.h>
+
+class Print;
+
+class Printable
+{
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+#endif
@@ -0,0 +1,314 @@
+/**************************************************************
+ *
+ * Throughput benchmark for a TinyGSM driver on the host.
+ *
+ * Downloads files through the driver's GsmClient from ModemSim
+ * at a number of baud rates and read sizes, and reports for
+ * each run:
+ *   - throughput in simulated time (bytes/s)
+ *   - AT commands sent per KB
+ *   - host CPU time per KB spent inside waitResponse() and
+ *     modemRead(), and in the whole read loop on the client
+ *     (excluding the simulator's own work)
+ *   - RAM: size of the modem and client objects, and the peak
+ *     heap used by String
+ *
+ * Build with one of -DTINY_GSM_MODEM_SIM800, _BG96, _UBLOX,
+ * _ESP8266 (see the Makefile), and -DTINY_GSM_READ_AHEAD=n to
+ * have the driver ask for the next chunk while the application
+ * works on the last one (SimBenchRA_<modem>).
+ *
+ * Usage: SimBench_<modem> [options]
+ *   -f file,...    files to download (default: extras/test_10k.bin,
+ *                  extras/test_100k.bin)
+ *   -b baud,...    baud rates (default: 9600,115200,460800)
+ *   -r size,...    bytes per client.read() call, 1 reads
+ *                  char by char (default: 1,512)
+ *   -n bytes/s     network throughput (default: unlimited)
+ *   -w us          simulated time the application spends on each
+ *                  KB it reads, e.g. writing it to flash (default: 0)
+ *   -c             switch RTS/CTS flow control on
+ *   -j             one JSON object per run instead of a table
+ *
+ **************************************************************/
+
+// The ESP8266 pushes whole segments (up to 1460 bytes) at once
+#ifndef TINY_GSM_RX_BUFFER
+  #define TINY_GSM_RX_BUFFER 2048
+#endif
+
+#include "HostSim.h"
+
+namespace SimBench {
+
+  enum Section {
+    waitResponse,
+    modemRead,
+    client,
+    SECTIONS
+  };
+
+  struct Counter {
+    uint64_t ns;
+    uint32_t calls;
+    uint8_t  depth;
+  };
+
+  Counter   counters[SECTIONS];
+  ModemSim* sim = NULL;
+
+  // Times the outermost call of a section, minus what the simulated modem
+  // spent handling commands in the meantime
+  class Probe {
+  public:
+    explicit Probe(Section s) : section(s), start(0), simStart(0) {
+      Counter& c = counters[section];
+      if (c.depth++) return;
+      c.calls++;
+      simStart = sim ? sim->stats().cpuNs : 0;
+      start = HostSim::cpuNs();
+    }
+    ~Probe() {
+      Counter& c = counters[section];
+      if (--c.depth) return;
+      uint64_t spent = HostSim::cpuNs() - start;
+      uint64_t simSpent = sim ? sim->stats().cpuNs - simStart : 0;
+      c.ns += spent > simSpent ? spent - simSpent : 0;
+    }
+  private:
+    Section  section;
+    uint64_t start;
+    uint64_t simStart;
+  };
+
+}  // namespace SimBench
+
+#define TINY_GSM_PROFILE(section) SimBench::Probe tinyGsmProbe(SimBench::section)
+
+#include <TinyGsmClient.h>
+
+#include <fstream>
+#include <iterator>
+
+#if defined(TINY_GSM_MODEM_SIM800)
+  #define SIM_DIALECT ModemSim::SIM800
+  #define SIM_NAME    "SIM800"
+#elif defined(TINY_GSM_MODEM_BG96)
+  #define SIM_DIALECT ModemSim::BG96
+  #define SIM_NAME    "BG96"
+#elif defined(TINY_GSM_MODEM_UBLOX)
+  #define SIM_DIALECT ModemSim::UBLOX
+  #define SIM_NAME    "UBLOX"
+#elif defined(TINY_GSM_MODEM_ESP8266)
+  #define SIM_DIALECT ModemSim::ESP8266
+  #define SIM_NAME    "ESP8266"
+#else
+  #error "ModemSim has no dialect for this modem"
+#endif
+
+struct Result {
+  bool     ok;
+  size_t   bytes;
+  double   seconds;        // simulated, connect to last byte
+  uint32_t commands;
+  uint64_t waitNs;
+  uint64_t readNs;
+  uint64_t clientNs;
+  uint32_t waitCalls;
+  uint32_t readCalls;
+  size_t   heapPeak;
+};
+
+static Result run(const std::string& body, uint32_t baud, size_t readSize,
+                  uint32_t netRate, uint32_t workUs, bool rtsCts) {
+  Result res;
+  memset(&res, 0, sizeof(res));
+  HostSim::stringHeap.peak = HostSim::stringHeap.current;
+
+  ModemSim sim(SIM_DIALECT, baud);
+  sim.setTrace(getenv("HOSTSIM_TRACE") != NULL);
+  sim.setNetworkRate(netRate);
+  SimBench::sim = &sim;
+
+  std::string request;
+  sim.onSend([&body, &request](ModemSim& modem, uint8_t mux, const std::string& data) {
+    request += data;
+    if (request.find("\r\n\r\n") == std::string::npos) return;
+    request.clear();
+    modem.serverData(mux, "HTTP/1.0 200 OK\r\nContent-Length: " +
+                          std::to_string(body.size()) + "\r\n\r\n");
+    for (size_t i = 0; i < body.size(); i += 1460) {
+      modem.serverData(mux, body.substr(i, 1460));
+    }
+    modem.serverClose(mux);
+  });
+
+  TinyGsm modem(sim);
+  TinyGsmClient client(modem);
+
+  bool up = modem.init();
+  up = up && (!rtsCts || modem.setFlowControl(true));
+#if defined(TINY_GSM_MODEM_HAS_GPRS)
+  up = up && modem.waitForNetwork() && modem.gprsConnect("internet", "", "");
+#else
+  up = up && modem.networkConnect("HostSim", "secret");
+#endif
+  if (!up || !client.connect("example.com", 80)) {
+    SimBench::sim = NULL;
+    return res;
+  }
+
+  memset(SimBench::counters, 0, sizeof(SimBench::counters));
+  sim.resetStats();
+  uint64_t start = HostSim::now();
+
+  client.print("GET /file HTTP/1.0\r\nHost: example.com\r\n\r\n");
+
+  std::string received;
+  uint8_t buf[1500];
+  size_t want = readSize < sizeof(buf) ? readSize : sizeof(buf);
+  uint32_t timeout = millis();
+  received.reserve(body.size() + 1024);
+  SimBench::Probe* probe = new SimBench::Probe(SimBench::client);
+  while (millis() - timeout < 10000L) {
+    int n = 0;
+    if (want > 1) {
+      n = client.read(buf, want);
+    } else {
+      int c = client.read();
+      if (c >= 0) {
+        buf[0] = c;
+        n = 1;
+      }
+    }
+    if (n > 0) {
+      received.append((char*)buf, n);
+      HostSim::advance((uint64_t)workUs * n / 1024);
+      timeout = millis();
+    } else if (!client.connected()) {
+      break;
+    }
+  }
+  delete probe;
+  res.seconds = (HostSim::now() - start) / 1e6;
+  client.stop();
+
+  size_t hdr = received.find("\r\n\r\n");
+  res.ok = hdr != std::string::npos && received.compare(hdr + 4, std::string::npos, body) == 0;
+  res.bytes = body.size();
+  res.commands = sim.stats().commands;
+  res.waitNs = SimBench::counters[SimBench::waitResponse].ns;
+  res.readNs = SimBench::counters[SimBench::modemRead].ns;
+  res.clientNs = SimBench::counters[SimBench::client].ns;
+  res.waitCalls = SimBench::counters[SimBench::waitResponse].calls;
+  res.readCalls = SimBench::counters[SimBench::modemRead].calls;
+  res.heapPeak = HostSim::stringHeap.peak - HostSim::stringHeap.current;
+  SimBench::sim = NULL;
+  return res;
+}
+
+static std::vector<std::string> split(const char* list) {
+  std::vector<std::string> res;
+  std::string cur;
+  for (const char* p = list; ; p++) {
+    if (*p == ',' || !*p) {
+      if (!cur.empty()) res.push_back(cur);
+      cur.clear();
+      if (!*p) break;
+    } else {
+      cur += *p;
+    }
+  }
+  return res;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> files = split("../../extras/test_10k.bin,../../extras/test_100k.bin");
+  std::vector<std::string> bauds = split("9600,115200,460800");
+  std::vector<std::string> reads = split("1,512");
+  uint32_t netRate = 0;
+  uint32_t workUs = 0;
+  bool json = false;
+  bool rtsCts = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string opt = argv[i];
+    if (opt == "-j") {
+      json = true;
+    } else if (opt == "-c") {
+      rtsCts = true;
+    } else if (i + 1 < argc && opt == "-f") {
+      files = split(argv[++i]);
+    } else if (i + 1 < argc && opt == "-b") {
+      bauds = split(argv[++i]);
+    } else if (i + 1 < argc && opt == "-r") {
+      reads = split(argv[++i]);
+    } else if (i + 1 < argc && opt == "-n") {
+      netRate = atol(argv[++i]);
+    } else if (i + 1 < argc && opt == "-w") {
+      workUs = atol(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [-f file,...] [-b baud,...] [-r size,...] [-n bytes/s] [-w us] [-c] [-j]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  size_t ramStatic = sizeof(TinyGsm) + sizeof(TinyGsmClient);
+  bool allOk = true;
+
+  if (!json) {
+    printf("%s, TinyGSM %s, RX buffer %u, read-ahead %u, flow control %s, objects %u bytes\n\n",
+           SIM_NAME, TINYGSM_VERSION, TINY_GSM_RX_BUFFER, TINY_GSM_READ_AHEAD,
+           rtsCts ? "on" : "off", (unsigned)ramStatic);
+    printf("%-22s %7s %5s %9s %7s %10s %10s %12s %6s  %s\n", "file", "baud", "read",
+           "bytes/s", "AT/KB", "wait us/KB", "read us/KB", "client us/KB", "heap", "result");
+  }
+
+  for (size_t f = 0; f < files.size(); f++) {
+    std::ifstream in(files[f].c_str(), std::ios::binary);
+    if (!in) {
+      fprintf(stderr, "Can't open %s\n", files[f].c_str());
+      return 2;
+    }
+    std::string body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string name = files[f].substr(files[f].find_last_of('/') + 1);
+
+    for (size_t b = 0; b < bauds.size(); b++) {
+      for (size_t r = 0; r < reads.size(); r++) {
+        uint32_t baud = atol(bauds[b].c_str());
+        size_t readSize = atol(reads[r].c_str());
+        Result res = run(body, baud, readSize, netRate, workUs, rtsCts);
+        double kb = res.bytes / 1024.0;
+        double rate = res.seconds > 0 ? res.bytes / res.seconds : 0;
+        allOk = allOk && res.ok;
+
+        if (json) {
+          printf("{\"modem\":\"%s\",\"version\":\"%s\",\"file\":\"%s\",\"bytes\":%u,"
+                 "\"baud\":%u,\"read_size\":%u,\"net_rate\":%u,\"work_us\":%u,"
+                 "\"read_ahead\":%u,\"flow_control\":%s,\"ok\":%s,"
+                 "\"seconds\":%.6f,\"bytes_per_s\":%.1f,\"at_commands\":%u,"
+                 "\"at_per_kb\":%.3f,\"wait_response_calls\":%u,"
+                 "\"wait_response_us_per_kb\":%.3f,\"modem_read_calls\":%u,"
+                 "\"modem_read_us_per_kb\":%.3f,\"client_us_per_kb\":%.3f,"
+                 "\"ram_objects\":%u,"
+                 "\"heap_peak\":%u}\n",
+                 SIM_NAME, TINYGSM_VERSION, name.c_str(), (unsigned)res.bytes,
+                 baud, (unsigned)readSize, netRate, workUs, TINY_GSM_READ_AHEAD,
+                 rtsCts ? "true" : "false", res.ok ? "true" : "false",
+                 res.seconds, rate, res.commands, res.commands / kb,
+                 res.waitCalls, res.waitNs / 1e3 / kb, res.readCalls,
+                 res.readNs / 1e3 / kb, res.clientNs / 1e3 / kb, (unsigned)ramStatic,
+                 (unsigned)res.heapPeak);
+        } else {
+          printf("%-22s %7u %5u %9.0f %7.2f %10.2f %10.2f %12.2f %6u  %s\n",
+                 name.c_str(), baud, (unsigned)readSize, rate,
+                 res.commands / kb, res.waitNs / 1e3 / kb, res.readNs / 1e3 / kb,
+                 res.clientNs / 1e3 / kb,
+                 (unsigned)res.heapPeak, res.ok ? "OK" : "FAILED");
+        }
+        fflush(stdout);
+      }
+    }
+  }
+  return allOk ? 0 : 1;
+}
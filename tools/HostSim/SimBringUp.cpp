@@ -0,0 +1,136 @@
+/**************************************************************
+ *
+ * Measures how long the driver takes to bring the modem up:
+ * TinyGsmAutoBaud() finding the modem's baud rate, init(),
+ * waitForNetwork() and gprsConnect(), in simulated time, and
+ * the AT commands that took.  On the SIM800 also
+ * a warm start (autobaud from the rate found before and
+ * init(state), after the application restarted with the modem
+ * still up) and restart().
+ *
+ * Build with one of -DTINY_GSM_MODEM_SIM800, _BG96, _UBLOX,
+ * and -DTINY_GSM_PIPELINE_DEPTH=n to run command batches
+ * pipelined (see the Makefile).
+ *
+ * Then, given a max_rate, negotiateBaud() moves the modem and
+ * the host up to the fastest rate that works; above bad_rate
+ * the line corrupts 1% of the bytes.
+ *
+ * Usage: SimBringUp_<modem> [-j] [baud [latency_us [max_rate [bad_rate]]]]
+ *   latency_us  time the modem takes to answer a command
+ *
+ **************************************************************/
+
+#include "HostSim.h"
+
+#include <TinyGsmClient.h>
+
+#if defined(TINY_GSM_MODEM_SIM800)
+  #define SIM_DIALECT ModemSim::SIM800
+  #define SIM_NAME    "SIM800"
+#elif defined(TINY_GSM_MODEM_BG96)
+  #define SIM_DIALECT ModemSim::BG96
+  #define SIM_NAME    "BG96"
+#elif defined(TINY_GSM_MODEM_UBLOX)
+  #define SIM_DIALECT ModemSim::UBLOX
+  #define SIM_NAME    "UBLOX"
+#else
+  #error "SimBringUp needs a modem with gprsConnect()"
+#endif
+
+int main(int argc, char* argv[]) {
+  bool json = argc > 1 && !strcmp(argv[1], "-j");
+  if (json) {
+    argc--;
+    argv++;
+  }
+  uint32_t baud = argc > 1 ? atol(argv[1]) : 9600;
+  uint32_t latency = argc > 2 ? atol(argv[2]) : 50000;
+  uint32_t maxRate = argc > 3 ? atol(argv[3]) : 0;
+
+  ModemSim sim(SIM_DIALECT, baud);
+  sim.setTrace(getenv("HOSTSIM_TRACE") != NULL);
+  sim.setLatency(latency);
+  if (argc > 4) {
+    sim.setLineErrors(atol(argv[4]), 10);
+  }
+
+  // The modem is at a fixed rate the host has to find first
+  sim.setModemBaud(baud);
+  uint64_t autobaudStart = HostSim::now();
+  uint32_t found = TinyGsmAutoBaud(sim, 2400, 460800);
+  bool ok = found == baud;
+  double autobaudMs = (HostSim::now() - autobaudStart) / 1e3;
+
+  TinyGsm modem(sim);
+#if defined(TINY_GSM_MODEM_SIM800)
+  TinyGsmWarmState state;
+  memset(&state, 0, sizeof(state));
+#endif
+
+  uint64_t start = HostSim::now();
+#if defined(TINY_GSM_MODEM_SIM800)
+  ok = ok && modem.init(state);
+#else
+  ok = ok && modem.init();
+#endif
+  uint64_t initUs = HostSim::now() - start;
+  ok = ok && modem.waitForNetwork();
+  uint64_t gprsStart = HostSim::now();
+  uint32_t gprsCommands = sim.stats().commands;
+  ok = ok && modem.gprsConnect("internet", "user", "pass");
+  uint64_t gprsUs = HostSim::now() - gprsStart;
+  gprsCommands = sim.stats().commands - gprsCommands;
+  uint64_t totalUs = HostSim::now() - start;
+
+  uint32_t rate = baud;
+  double negotiateMs = 0;
+  if (maxRate) {
+    uint64_t negotiateStart = HostSim::now();
+    rate = modem.negotiateBaud(sim, baud, maxRate);
+    negotiateMs = (HostSim::now() - negotiateStart) / 1e3;
+    ok = ok && rate && rate == sim.getModemBaud();
+  }
+
+  // The application restarts, the modem stays up
+  double warmMs = 0, restartMs = 0;
+  uint32_t warmCommands = 0;
+#if defined(TINY_GSM_MODEM_SIM800)
+  {
+    TinyGsm again(sim);
+    uint64_t warmStart = HostSim::now();
+    warmCommands = sim.stats().commands;
+    state.baud = rate;
+    ok = ok && TinyGsmAutoBaud(sim, 2400, 921600, state.baud) == rate;
+    ok = ok && again.init(state) && again.waitForNetwork() &&
+         again.gprsConnect("internet", "user", "pass");
+    warmMs = (HostSim::now() - warmStart) / 1e3;
+    warmCommands = sim.stats().commands - warmCommands;
+
+    uint64_t restartStart = HostSim::now();
+    ok = ok && again.restart();
+    restartMs = (HostSim::now() - restartStart) / 1e3;
+  }
+#endif
+
+  if (json) {
+    printf("{\"modem\":\"" SIM_NAME "\",\"pipeline\":%d,\"baud\":%u,\"latency_us\":%u,"
+           "\"autobaud_ms\":%.1f,\"init_ms\":%.1f,\"gprs_ms\":%.1f,\"gprs_commands\":%u,\"total_ms\":%.1f,"
+           "\"rate\":%u,\"negotiate_ms\":%.1f,\"warm_ms\":%.1f,\"warm_commands\":%u,\"restart_ms\":%.1f,\"ok\":%s}\n",
+           TINY_GSM_PIPELINE_DEPTH, baud, latency, autobaudMs, initUs / 1e3, gprsUs / 1e3,
+           gprsCommands, totalUs / 1e3, rate, negotiateMs, warmMs, warmCommands, restartMs, ok ? "true" : "false");
+  } else {
+    printf("%-8s pipeline %d  %7u baud  %6u us latency  autobaud %7.1f ms  init %7.1f ms  gprsConnect %7.1f ms"
+           " (%u commands)  total %7.1f ms",
+           SIM_NAME, TINY_GSM_PIPELINE_DEPTH, baud, latency, autobaudMs, initUs / 1e3, gprsUs / 1e3,
+           gprsCommands, totalUs / 1e3);
+    if (maxRate) {
+      printf("  negotiated %u baud in %.1f ms", rate, negotiateMs);
+    }
+    if (warmCommands) {
+      printf("  warm %7.1f ms (%u commands)  restart %7.1f ms", warmMs, warmCommands, restartMs);
+    }
+    printf("  %s\n", ok ? "OK" : "FAILED");
+  }
+  return ok ? 0 : 1;
+}
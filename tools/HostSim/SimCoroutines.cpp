@@ -0,0 +1,144 @@
+/**************************************************************
+ *
+ * Runs TinyGsmCoroutines on the host against ModemSim: two
+ * coroutines download a file each over their own socket while
+ * a third one samples the signal quality, all on one thread.
+ * A command too long for the queue fails instead of hanging.
+ *
+ * Build with -std=c++20 and one of -DTINY_GSM_MODEM_SIM800,
+ * _BG96, _UBLOX (see the Makefile).
+ *
+ * Usage: SimCoro_<modem> [file [net_rate]]
+ *
+ **************************************************************/
+
+#define TINY_GSM_RX_BUFFER 2048
+
+#include "HostSim.h"
+
+#include <TinyGsmClient.h>
+#include <TinyGsmCoroutine.h>
+
+#include <fstream>
+#include <iterator>
+
+#if defined(TINY_GSM_MODEM_SIM800)
+  #define SIM_DIALECT ModemSim::SIM800
+  #define SIM_NAME    "SIM800"
+#elif defined(TINY_GSM_MODEM_BG96)
+  #define SIM_DIALECT ModemSim::BG96
+  #define SIM_NAME    "BG96"
+#elif defined(TINY_GSM_MODEM_UBLOX)
+  #define SIM_DIALECT ModemSim::UBLOX
+  #define SIM_NAME    "UBLOX"
+#else
+  #error "SimCoroutines needs a modem with connectAsync()"
+#endif
+
+typedef TinyGsmCoroutines<TinyGsm, 512> Coroutines;
+
+struct Download {
+  const char* name;
+  std::string received;
+  bool        connected;
+  bool        finished;
+};
+
+static TinyGsmTask download(Coroutines& gsm, TinyGsmClient& client, Download& d) {
+  d.connected = co_await gsm.connect(client, d.name, 80, 10);
+  if (d.connected) {
+    client.print("GET / HTTP/1.0\r\n\r\n");
+    uint8_t buf[64];
+    while (int n = co_await gsm.readSome(client, buf, sizeof(buf))) {
+      d.received.append((const char*)buf, n);
+    }
+    client.stop();
+  }
+  d.finished = true;
+}
+
+static TinyGsmTask signal(Coroutines& gsm, const bool& stop, int& samples) {
+  while (!stop) {
+    TinyGsmCommandResult csq = co_await gsm.command(GF("+CSQ"));
+    if (csq.result == 1) {
+      samples++;
+    }
+    co_await gsm.sleep(500);
+  }
+}
+
+// Longer than TINY_GSM_QUEUE_CMD_LEN, so it can never be queued
+static TinyGsmTask tooLong(Coroutines& gsm, int& result) {
+  TinyGsmCommandResult r =
+    co_await gsm.command(GF("+CGDCONT=1,\"IP\",\"a.very.long.apn.example.com\""));
+  result = r.result;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../../extras/test_10k.bin";
+
+  std::ifstream f(path, std::ios::binary);
+  if (!f) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return 2;
+  }
+  std::string body((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+  ModemSim sim(SIM_DIALECT, 115200);
+  sim.setTrace(getenv("HOSTSIM_TRACE") != NULL);
+  sim.setLatency(20000);
+  sim.setConnectTime(500000);
+  sim.setNetworkRate(argc > 2 ? atol(argv[2]) : 20000);
+
+  // Answers a request on any socket with the file
+  std::string requests[ModemSim::MUX_COUNT];
+  sim.onSend([&body, &requests](ModemSim& modem, uint8_t mux, const std::string& data) {
+    requests[mux] += data;
+    if (requests[mux].find("\r\n\r\n") == std::string::npos) return;
+    requests[mux].clear();
+    for (size_t i = 0; i < body.size(); i += 1460) {
+      modem.serverData(mux, body.substr(i, 1460));
+    }
+    modem.serverClose(mux);
+  });
+
+  TinyGsmRxPump<512> pump(sim);
+  TinyGsm modem(pump);
+  TinyGsmClient a(modem, 0);
+  TinyGsmClient b(modem, 1);
+  Coroutines gsm(modem, pump);
+
+  if (!modem.init() || !modem.waitForNetwork() || !modem.gprsConnect("internet", "", "")) {
+    fprintf(stderr, SIM_NAME ": modem didn't come up\n");
+    return 1;
+  }
+
+  Download da = { "a.example.com", std::string(), false, false };
+  Download db = { "b.example.com", std::string(), false, false };
+  bool stop = false;
+  int samples = 0;
+
+  uint64_t start = HostSim::now();
+  download(gsm, a, da);
+  download(gsm, b, db);
+  signal(gsm, stop, samples);
+  int longResult = -1;
+  tooLong(gsm, longResult);
+
+  long loops = 0;
+  while (!gsm.idle() && HostSim::now() - start < 120000000ULL) {
+    gsm.tick();
+    loops++;
+    stop = da.finished && db.finished;
+    HostSim::advance(100);
+  }
+
+  double secs = (HostSim::now() - start) / 1e6;
+  bool ok = da.received == body && db.received == body && samples > 0 && gsm.idle() &&
+            longResult == 0;
+  printf(SIM_NAME ": a %s %zu/%zu, b %s %zu/%zu, %d signal samples, %ld loops, %.2fs: %s\n",
+         da.connected ? "connected" : "failed", da.received.size(), body.size(),
+         db.connected ? "connected" : "failed", db.received.size(), body.size(),
+         samples, loops, secs, ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
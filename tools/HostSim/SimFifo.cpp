@@ -0,0 +1,285 @@
+/**************************************************************
+ *
+ * Microbenchmark of TinyGsmFifo against the FIFO it replaced
+ * (signed indices, % N on every step, copy in/out only).
+ *
+ * Pushes a file through a FIFO of each size the way the
+ * receive path does: the writer adds a run of bytes (runs of
+ * 1, 7, 64, 300 and 1460 bytes, as much as fits), then the
+ * reader takes out everything there is.  Each FIFO is run
+ *   - byte by byte, put(c) / get(&c)
+ *   - in bulk, put(p, n) / get(p, n)
+ *   - for the new one also in place, writeSpan() / commit()
+ *     and readSpan() / consume()
+ * and what comes out is checked against the file.  Reports
+ * host CPU time per byte, the best of several passes.
+ *
+ * Usage: SimFifo [file [passes]]
+ *   (default: extras/test_1m.bin, 5 passes)
+ *
+ **************************************************************/
+
+#include "HostSim.h"
+
+#include <TinyGsmFifo.h>
+
+#include <fstream>
+#include <iterator>
+
+namespace Old {
+
+// src/TinyGsmFifo.h before the indices were masked
+template <class T, unsigned N>
+class TinyGsmFifo
+{
+public:
+    TinyGsmFifo()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        _r = 0;
+        _w = 0;
+    }
+
+    int free(void)
+    {
+        int s = _r - _w;
+        if (s <= 0)
+            s += N;
+        return s - 1;
+    }
+
+    bool put(const T& c)
+    {
+        int i = _w;
+        int j = i;
+        i = _inc(i);
+        if (i == _r) // !writeable()
+            return false;
+        _b[j] = c;
+        _w = i;
+        return true;
+    }
+
+    int put(const T* p, int n, bool t = false)
+    {
+        int c = n;
+        while (c)
+        {
+            int f;
+            while ((f = free()) == 0) // wait for space
+            {
+                if (!t) return n - c; // no more space and not blocking
+                /* nothing / just wait */;
+            }
+            // check free space
+            if (c < f) f = c;
+            int w = _w;
+            int m = N - w;
+            // check wrap
+            if (f > m) f = m;
+            memcpy(&_b[w], p, f);
+            _w = _inc(w, f);
+            c -= f;
+            p += f;
+        }
+        return n - c;
+    }
+
+    size_t size(void)
+    {
+        int s = _w - _r;
+        if (s < 0)
+            s += N;
+        return s;
+    }
+
+    bool get(T* p)
+    {
+        int r = _r;
+        if (r == _w) // !readable()
+            return false;
+        *p = _b[r];
+        _r = _inc(r);
+        return true;
+    }
+
+    int get(T* p, int n, bool t = false)
+    {
+        int c = n;
+        while (c)
+        {
+            int f;
+            for (;;) // wait for data
+            {
+                f = size();
+                if (f)  break;        // free space
+                if (!t) return n - c; // no space and not blocking
+                /* nothing / just wait */;
+            }
+            // check available data
+            if (c < f) f = c;
+            int r = _r;
+            int m = N - r;
+            // check wrap
+            if (f > m) f = m;
+            memcpy(p, &_b[r], f);
+            _r = _inc(r, f);
+            c -= f;
+            p += f;
+        }
+        return n - c;
+    }
+
+private:
+    int _inc(int i, int n = 1)
+    {
+        return (i + n) % N;
+    }
+
+    T    _b[N];
+    int  _w;
+    int  _r;
+};
+
+}  // namespace Old
+
+// The ways to move a run of bytes in and everything there is out
+
+struct Bytes {
+  static const char* name() { return "byte"; }
+  template<class Fifo>
+  static size_t in(Fifo& fifo, const uint8_t* p, size_t n) {
+    size_t done = 0;
+    while (done < n && fifo.put(p[done])) done++;
+    return done;
+  }
+  template<class Fifo>
+  static size_t out(Fifo& fifo, uint8_t* p) {
+    size_t done = 0;
+    while (fifo.get(p + done)) done++;
+    return done;
+  }
+};
+
+struct Bulk {
+  static const char* name() { return "bulk"; }
+  template<class Fifo>
+  static size_t in(Fifo& fifo, const uint8_t* p, size_t n) {
+    return fifo.put(p, n);
+  }
+  template<class Fifo>
+  static size_t out(Fifo& fifo, uint8_t* p) {
+    return fifo.get(p, fifo.size());
+  }
+};
+
+// Only the new FIFO has these
+struct Spans {
+  static const char* name() { return "span"; }
+  template<class Fifo>
+  static size_t in(Fifo& fifo, const uint8_t* p, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+      size_t space;
+      uint8_t* dst = fifo.writeSpan(space);
+      if (!dst) break;
+      if (space > n - done) space = n - done;
+      memcpy(dst, p + done, space);
+      fifo.commit(space);
+      done += space;
+    }
+    return done;
+  }
+  template<class Fifo>
+  static size_t out(Fifo& fifo, uint8_t* p) {
+    size_t done = 0;
+    size_t n;
+    while (const uint8_t* src = fifo.readSpan(n)) {
+      memcpy(p + done, src, n);
+      fifo.consume(n);
+      done += n;
+    }
+    return done;
+  }
+};
+
+static const size_t runs[] = { 1, 7, 64, 300, 1460 };
+
+// One pass of the file through a FIFO, in ns per byte; 0 if it came out wrong
+template<class Fifo, class Move>
+static double pass(const std::string& in, std::string& out) {
+  Fifo* fifo = new Fifo();
+  const uint8_t* src = (const uint8_t*)in.data();
+  uint8_t* dst = (uint8_t*)&out[0];
+  size_t w = 0, r = 0, k = 0;
+
+  uint64_t start = HostSim::cpuNs();
+  while (r < in.size()) {
+    size_t n = runs[k++ % (sizeof(runs) / sizeof(runs[0]))];
+    if (n > in.size() - w) n = in.size() - w;
+    w += Move::in(*fifo, src + w, n);
+    r += Move::out(*fifo, dst + r);
+  }
+  uint64_t spent = HostSim::cpuNs() - start;
+  delete fifo;
+
+  if (out != in) return 0;
+  return (double)spent / in.size();
+}
+
+template<class Fifo, class Move>
+static double best(const std::string& in, int passes) {
+  std::string out(in.size(), '\0');
+  double res = 0;
+  for (int i = 0; i < passes; i++) {
+    double ns = pass<Fifo, Move>(in, out);
+    if (!ns) return 0;
+    if (!res || ns < res) res = ns;
+  }
+  return res;
+}
+
+template<unsigned N, class Move>
+static bool compare(const std::string& in, int passes) {
+  double before = best<Old::TinyGsmFifo<uint8_t, N>, Move>(in, passes);
+  double after = best<TinyGsmFifo<uint8_t, N>, Move>(in, passes);
+  bool good = before && after;
+  printf("%6u  %-5s %10.3f %10.3f %7.2fx  %s\n", N, Move::name(), before, after,
+         good ? before / after : 0, good ? "OK" : "CORRUPT");
+  return good;
+}
+
+template<unsigned N>
+static bool compare(const std::string& in, int passes) {
+  bool ok = compare<N, Bytes>(in, passes);
+  ok = compare<N, Bulk>(in, passes) && ok;
+  double after = best<TinyGsmFifo<uint8_t, N>, Spans>(in, passes);
+  printf("%6u  %-5s %10s %10.3f %8s  %s\n", N, Spans::name(), "-", after, "-",
+         after ? "OK" : "CORRUPT");
+  return after && ok;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "../../extras/test_1m.bin";
+  int passes = argc > 2 ? atoi(argv[2]) : 5;
+
+  std::ifstream f(path, std::ios::binary);
+  if (!f) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return 2;
+  }
+  std::string in((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+  printf("%s, %zu bytes, best of %d passes, ns/byte\n\n", path, in.size(), passes);
+  printf("%6s  %-5s %10s %10s %8s  %s\n", "size", "mode", "old", "new", "speedup", "result");
+  bool ok = true;
+  ok = compare<64>(in, passes) && ok;
+  ok = compare<650>(in, passes) && ok;
+  ok = compare<1024>(in, passes) && ok;
+  ok = compare<2048>(in, passes) && ok;
+  return ok ? 0 : 1;
+}
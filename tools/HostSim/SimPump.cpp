@@ -0,0 +1,108 @@
+/**************************************************************
+ *
+ * Checks TinyGsmRxPump on the host against ModemSim with a
+ * small host UART buffer at a high baud rate.
+ *
+ * A burst of URC's arrives while the application is busy and
+ * not reading from the modem:
+ *   - without the pump the UART buffer overflows, and URC's
+ *     are lost
+ *   - with the pump polled every 100us, as from a timer
+ *     interrupt, everything arrives and the driver handles
+ *     every URC afterwards
+ *
+ * Build with one of -DTINY_GSM_MODEM_SIM800, _BG96, _UBLOX
+ * (see the Makefile).
+ *
+ * Usage: SimPump_<modem> [baud [uart_buffer]]
+ *   (default: 921600 baud, 64 byte UART buffer)
+ *
+ **************************************************************/
+
+#include "HostSim.h"
+
+#include <TinyGsmClient.h>
+#include <TinyGsmRxPump.h>
+
+#if defined(TINY_GSM_MODEM_SIM800)
+  #define SIM_DIALECT ModemSim::SIM800
+  #define SIM_NAME    "SIM800"
+#elif defined(TINY_GSM_MODEM_BG96)
+  #define SIM_DIALECT ModemSim::BG96
+  #define SIM_NAME    "BG96"
+#elif defined(TINY_GSM_MODEM_UBLOX)
+  #define SIM_DIALECT ModemSim::UBLOX
+  #define SIM_NAME    "UBLOX"
+#else
+  #error "ModemSim has no dialect for this modem"
+#endif
+
+static const int URCS = 20;
+
+static void onTest(const char* line, void* arg) {
+  char expect[16];
+  int& seen = *(int*)arg;
+  snprintf(expect, sizeof(expect), "+TEST: %d", seen);
+  if (!strcmp(line, expect)) seen++;
+}
+
+// The application is busy for busyUs; the pump is polled every pollUs
+// meanwhile if pollUs isn't 0.  Returns how many URC's the driver saw,
+// in order.
+static int burst(ModemSim& sim, TinyGsm& modem, TinyGsmRxPump<512>* pump,
+                 uint32_t busyUs, uint32_t pollUs) {
+  int seen = 0;
+  modem.addUrcHandler(GF("+TEST:"), onTest, &seen);
+  for (int i = 0; i < URCS; i++) {
+    sim.urc("\r\n+TEST: " + std::to_string(i) + "\r\n");
+  }
+  for (uint32_t t = 0; t < busyUs; ) {
+    uint32_t step = pollUs ? pollUs : busyUs;
+    HostSim::advance(step);
+    t += step;
+    if (pump) pump->poll();
+  }
+  modem.waitResponse(100, NULL, NULL);
+  modem.removeUrcHandler(GF("+TEST:"));
+  return seen;
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t baud = argc > 1 ? atol(argv[1]) : 921600;
+  size_t uartBuffer = argc > 2 ? atol(argv[2]) : 64;
+  bool ok = true;
+
+  {
+    ModemSim sim(SIM_DIALECT, baud);
+    sim.setTrace(getenv("HOSTSIM_TRACE") != NULL);
+    TinyGsm modem(sim);
+    bool up = modem.init();
+    sim.setUartBuffer(uartBuffer);
+    sim.resetStats();
+    int seen = burst(sim, modem, NULL, 10000, 0);
+    // Shows the test can fail: the burst doesn't fit into the UART
+    bool good = up && seen < URCS && sim.stats().bytesLost > 0;
+    printf("%-8s %8u baud  UART %4u  no pump      %2d of %d URC's, %6u bytes lost  %s\n",
+           SIM_NAME, baud, (unsigned)uartBuffer, seen, URCS,
+           (unsigned)sim.stats().bytesLost, good ? "OK" : "FAILED");
+    ok = ok && good;
+  }
+
+  {
+    ModemSim sim(SIM_DIALECT, baud);
+    sim.setTrace(getenv("HOSTSIM_TRACE") != NULL);
+    TinyGsmRxPump<512> pump(sim);
+    TinyGsm modem(pump);
+    bool up = modem.init();
+    sim.setUartBuffer(uartBuffer);
+    sim.resetStats();
+    int seen = burst(sim, modem, &pump, 10000, 100);
+    bool good = up && seen == URCS && sim.stats().bytesLost == 0 && !pump.overflowed();
+    printf("%-8s %8u baud  UART %4u  pump, 100us  %2d of %d URC's, %6u bytes lost  %s\n",
+           SIM_NAME, baud, (unsigned)uartBuffer, seen, URCS,
+           (unsigned)sim.stats().bytesLost, good ? "OK" : "FAILED");
+    ok = ok && good;
+  }
+
+  return ok ? 0 : 1;
+}
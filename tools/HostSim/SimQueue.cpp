@@ -0,0 +1,205 @@
+/**************************************************************
+ *
+ * Checks TinyGsmCommandQueue on the host against ModemSim,
+ * driven from a plain loop as an Arduino sketch would:
+ *   - queued commands complete in order with their answers,
+ *     and no tick() waits for the modem
+ *   - a URC arriving a few bytes at a time is handled once,
+ *     whole, however the ticks fall
+ *   - a URC in the middle of a command's answer
+ *   - a line ending in "OK" before the answer doesn't end the
+ *     command, nor make a tick wait for the rest
+ *   - +CME ERROR ends a command with an error right away
+ *   - a command with its own final response
+ *   - a command the modem doesn't answer in time; the driver's
+ *     blocking functions still work afterwards
+ *   - the late answer to a command that timed out doesn't
+ *     complete the next one
+ *
+ * Build with one of -DTINY_GSM_MODEM_SIM800, _BG96, _UBLOX
+ * (see the Makefile).
+ *
+ * Usage: SimQueue_<modem> [baud]
+ *
+ **************************************************************/
+
+#include "HostSim.h"
+
+#include <TinyGsmClient.h>
+#include <TinyGsmCommandQueue.h>
+
+#if defined(TINY_GSM_MODEM_SIM800)
+  #define SIM_DIALECT ModemSim::SIM800
+  #define SIM_NAME    "SIM800"
+#elif defined(TINY_GSM_MODEM_BG96)
+  #define SIM_DIALECT ModemSim::BG96
+  #define SIM_NAME    "BG96"
+#elif defined(TINY_GSM_MODEM_UBLOX)
+  #define SIM_DIALECT ModemSim::UBLOX
+  #define SIM_NAME    "UBLOX"
+#else
+  #error "ModemSim has no dialect for this modem"
+#endif
+
+typedef TinyGsmCommandQueue<TinyGsm, 256> Queue;
+
+struct Answer {
+  bool    done;
+  uint8_t result;
+  String  text;
+};
+
+static void onDone(uint8_t result, const String& text, void* arg) {
+  Answer& a = *(Answer*)arg;
+  a.done = true;
+  a.result = result;
+  a.text = text;
+}
+
+static std::string urcs;
+
+static void onTest(const char* line, void*) {
+  urcs += line;
+  urcs += ';';
+}
+
+// Ticks every stepUs until done() or the time is up; the longest a single
+// tick took is kept in maxTickUs
+template<class Done>
+static bool loop(Queue& queue, uint32_t stepUs, uint32_t limitUs, Done done,
+                 uint64_t& maxTickUs) {
+  for (uint64_t start = HostSim::now(); HostSim::now() - start < limitUs; ) {
+    uint64_t before = HostSim::now();
+    queue.tick();
+    uint64_t took = HostSim::now() - before;
+    if (took > maxTickUs) maxTickUs = took;
+    if (done()) return true;
+    HostSim::advance(stepUs);
+  }
+  return false;
+}
+
+static bool report(const char* what, bool good) {
+  printf("%-8s %-40s %s\n", SIM_NAME, what, good ? "OK" : "FAILED");
+  return good;
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t baud = argc > 1 ? atol(argv[1]) : 115200;
+
+  ModemSim sim(SIM_DIALECT, baud);
+  sim.setTrace(getenv("HOSTSIM_TRACE") != NULL);
+  TinyGsmRxPump<256> pump(sim);
+  TinyGsm modem(pump);
+  Queue queue(modem, pump);
+  bool ok = true;
+
+  ok = report("init", modem.init()) && ok;
+  modem.addUrcHandler(GF("+TEST:"), onTest);
+
+  {
+    Answer a[3] = {};
+    queue.add(GF("+CSQ"), onDone, &a[0]);
+    queue.add(GF("+CPIN?"), onDone, &a[1]);
+    queue.add(GF("+CGMI"), onDone, &a[2]);
+    uint64_t maxTick = 0;
+    bool done = loop(queue, 50, 1000000, [&]{ return !queue.pending(); }, maxTick);
+    bool good = done && a[0].done && a[0].result == 1 && a[0].text.indexOf("+CSQ: 21,0") >= 0 &&
+                a[1].done && a[1].result == 1 && a[1].text.indexOf("+CPIN: READY") >= 0 &&
+                a[2].done && a[2].result == 1;
+    // A tick takes in what's there; the modem's latency alone is 2 ms
+    good = good && maxTick < 1000;
+    ok = report("three commands, in order, no waiting", good) && ok;
+  }
+
+  {
+    // Ticks falling at different points of the line
+    static const uint32_t steps[] = { 10, 20, 35, 50, 87, 130, 200, 500 };
+    bool good = true;
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+      urcs.clear();
+      sim.urc("\r\n+TEST: split\r\n");
+      uint64_t maxTick = 0;
+      bool done = loop(queue, steps[i], 100000, [&]{ return !urcs.empty(); }, maxTick);
+      // Give a URC that was cut in two the chance to show up twice
+      loop(queue, steps[i], 5000, []{ return false; }, maxTick);
+      good = good && done && urcs == "+TEST: split;";
+    }
+    ok = report("URC arriving between ticks", good) && ok;
+  }
+
+  {
+    urcs.clear();
+    Answer a = {};
+    queue.add(GF("+CSQ"), onDone, &a);
+    queue.tick();
+    sim.urc("\r\n+TEST: during\r\n");
+    uint64_t maxTick = 0;
+    loop(queue, 20, 100000, [&]{ return a.done && !urcs.empty(); }, maxTick);
+    ok = report("URC during a command",
+                a.done && a.result == 1 && urcs == "+TEST: during;") && ok;
+  }
+
+  {
+    Answer a = {};
+    sim.setLatency(50000);
+    queue.add(GF("+CSQ"), onDone, &a);
+    sim.urc("\r\nSHUT OK\r\n");  // Comes in before the answer
+    uint64_t maxTick = 0;
+    loop(queue, 50, 200000, [&]{ return a.done; }, maxTick);
+    sim.setLatency(2000);
+    bool good = a.done && a.result == 1 && a.text.indexOf("+CSQ: 21,0") >= 0;
+    ok = report("line ending in OK, no waiting", good && maxTick < 1000) && ok;
+  }
+
+  {
+    Answer a = {};
+    queue.add(GF("+CPIN=\"0000\""), onDone, &a, 10000L);
+    uint64_t maxTick = 0;
+    loop(queue, 50, 100000, [&]{ return a.done; }, maxTick);
+    bool good = a.done && a.result == 2 && a.text.indexOf("+CME ERROR: 16") >= 0;
+    ok = report("+CME ERROR", good) && ok;
+  }
+
+  {
+    Answer a = {};
+    queue.add(GF("+CSQ"), onDone, &a, 1000L, GF("+CSQ: 21,0"));
+    uint64_t maxTick = 0;
+    loop(queue, 50, 100000, [&]{ return a.done; }, maxTick);
+    // The OK after it is taken in while the queue is idle
+    loop(queue, 50, 10000, []{ return false; }, maxTick);
+    bool good = a.done && a.result == 1 && a.text.indexOf("+CSQ: 21,0") >= 0 &&
+                a.text.indexOf("OK") < 0 && !queue.busy();
+    ok = report("own final response", good) && ok;
+  }
+
+  {
+    Answer a = {};
+    sim.setLatency(50000);
+    queue.add(GF("+CSQ"), onDone, &a, 20);
+    uint64_t maxTick = 0;
+    loop(queue, 50, 100000, [&]{ return a.done; }, maxTick);
+    sim.setLatency(2000);
+    // The late answer comes in while the queue is idle
+    loop(queue, 50, 100000, []{ return false; }, maxTick);
+    bool good = a.done && a.result == 0 && !queue.busy();
+    good = good && modem.getSignalQuality() == 21;
+    ok = report("timeout, then a blocking call", good) && ok;
+  }
+
+  {
+    Answer a[2] = {};
+    sim.setLatency(50000);
+    queue.add(GF("+CSQ"), onDone, &a[0], 20);
+    queue.add(GF("+CPIN?"), onDone, &a[1]);
+    uint64_t maxTick = 0;
+    loop(queue, 50, 500000, [&]{ return a[1].done; }, maxTick);
+    sim.setLatency(2000);
+    bool good = a[0].done && a[0].result == 0 && a[1].done && a[1].result == 1 &&
+                a[1].text.indexOf("+CPIN: READY") >= 0 &&
+                a[1].text.indexOf("+CSQ") < 0;
+    ok = report("late answer, then the next command", good) && ok;
+  }
+
+  return ok ? 0 : 1;
+}
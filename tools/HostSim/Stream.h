@@ -0,0 +1,146 @@
+/**
+ * @file       Stream.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Nov 2016
+ *
+ * The parts of the Arduino Stream class TinyGSM uses, with the same
+ * time-out behaviour as the AVR core.
+ */
+
+#ifndef Stream_h
+#define Stream_h
+
+#include "Print.h"
+
+unsigned long millis();
+
+class Stream : public Print
+{
+public:
+  Stream() : _timeout(1000) {}
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  unsigned long getTimeout() { return _timeout; }
+
+  bool find(const char* target) { return findUntil(target, NULL); }
+  bool find(char target) { char t[2] = { target, 0 }; return find(t); }
+
+  bool findUntil(const char* target, const char* terminator) {
+    size_t tlen = strlen(target);
+    size_t mlen = terminator ? strlen(terminator) : 0;
+    size_t ti = 0, mi = 0;
+    if (!tlen) return true;
+    int c;
+    while ((c = timedRead()) >= 0) {
+      ti = (c == target[ti]) ? ti + 1 : (c == target[0]);
+      if (ti >= tlen) return true;
+      if (mlen) {
+        mi = (c == terminator[mi]) ? mi + 1 : (c == terminator[0]);
+        if (mi >= mlen) return false;
+      }
+    }
+    return false;
+  }
+
+  long parseInt() {
+    int c = peekNextDigit();
+    if (c < 0) return 0;
+    bool negative = false;
+    long value = 0;
+    if (c == '-') {
+      negative = true;
+      read();
+    }
+    while ((c = timedPeek()) >= 0 && c >= '0' && c <= '9') {
+      value = value * 10 + c - '0';
+      read();
+    }
+    return negative ? -value : value;
+  }
+
+  float parseFloat() {
+    int c = peekNextDigit();
+    if (c < 0) return 0;
+    String s;
+    while ((c = timedPeek()) >= 0 && (c == '-' || c == '.' || (c >= '0' && c <= '9'))) {
+      s += (char)c;
+      read();
+    }
+    return s.toFloat();
+  }
+
+  size_t readBytes(char* buf, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+      int c = timedRead();
+      if (c < 0) break;
+      buf[n++] = (char)c;
+    }
+    return n;
+  }
+  size_t readBytes(uint8_t* buf, size_t length) {
+    return readBytes((char*)buf, length);
+  }
+
+  size_t readBytesUntil(char terminator, char* buf, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+      int c = timedRead();
+      if (c < 0 || c == terminator) break;
+      buf[n++] = (char)c;
+    }
+    return n;
+  }
+  size_t readBytesUntil(char terminator, uint8_t* buf, size_t length) {
+    return readBytesUntil(terminator, (char*)buf, length);
+  }
+
+  String readString() {
+    String s;
+    int c;
+    while ((c = timedRead()) >= 0) s += (char)c;
+    return s;
+  }
+
+  String readStringUntil(char terminator) {
+    String s;
+    int c;
+    while ((c = timedRead()) >= 0 && c != terminator) s += (char)c;
+    return s;
+  }
+
+protected:
+  int timedRead() {
+    unsigned long start = millis();
+    do {
+      int c = read();
+      if (c >= 0) return c;
+    } while (millis() - start < _timeout);
+    return -1;
+  }
+
+  int timedPeek() {
+    unsigned long start = millis();
+    do {
+      int c = peek();
+      if (c >= 0) return c;
+    } while (millis() - start < _timeout);
+    return -1;
+  }
+
+  int peekNextDigit() {
+    int c;
+    while ((c = timedPeek()) >= 0 && !(c == '-' || (c >= '0' && c <= '9'))) read();
+    return c;
+  }
+
+  unsigned long _timeout;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/**
+ * @file       WString.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Nov 2016
+ *
+ * Arduino String on top of std::basic_string, for host builds only.  Its
+ * heap use is counted, like String on a microcontroller it's the only
+ * dynamic allocation the drivers make.
+ */
+
+#ifndef WString_h
+#define WString_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <algorithm>
+#include <memory>
+
+namespace HostSim {
+
+  struct HeapStats {
+    size_t current;
+    size_t peak;
+  };
+  // Bytes allocated by String objects
+  extern HeapStats stringHeap;
+
+  template<class T>
+  struct StringAllocator : std::allocator<T> {
+    template<class U> struct rebind { typedef StringAllocator<U> other; };
+    StringAllocator() {}
+    template<class U> StringAllocator(const StringAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+      stringHeap.current += n * sizeof(T);
+      if (stringHeap.current > stringHeap.peak) stringHeap.peak = stringHeap.current;
+      return std::allocator<T>::allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+      stringHeap.current -= n * sizeof(T);
+      std::allocator<T>::deallocate(p, n);
+    }
+  };
+
+}  // namespace HostSim
+
+class String
+{
+  typedef std::basic_string<char, std::char_traits<char>,
+                            HostSim::StringAllocator<char> > Str;
+
+public:
+  String() {}
+  String(const char* c) : s(c ? c : "") {}
+  String(const std::string& c) : s(c.data(), c.size()) {}
+  explicit String(char c) : s(1, c) {}
+  explicit String(unsigned char v, unsigned char base = 10) { fromNumber(v, base); }
+  explicit String(int v, unsigned char base = 10) { fromNumber(v, base); }
+  explicit String(unsigned int v, unsigned char base = 10) { fromNumber(v, base); }
+  explicit String(long v, unsigned char base = 10) { fromNumber(v, base); }
+  explicit String(unsigned long v, unsigned char base = 10) { fromNumber(v, base); }
+  explicit String(float v, unsigned char digits = 2) { fromFloat(v, digits); }
+  explicit String(double v, unsigned char digits = 2) { fromFloat(v, digits); }
+
+  unsigned int length() const { return s.size(); }
+  bool reserve(unsigned int n) { s.reserve(n); return true; }
+  const char* c_str() const { return s.c_str(); }
+
+  char charAt(unsigned int i) const { return i < s.size() ? s[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  char& operator[](unsigned int i) { return s[i]; }
+
+  String& operator+=(const String& o) { s += o.s; return *this; }
+  String& operator+=(const char* o) { if (o) s += o; return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  String& operator+=(unsigned char v) { return *this += String(v); }
+  String& operator+=(int v) { return *this += String(v); }
+  String& operator+=(unsigned int v) { return *this += String(v); }
+  String& operator+=(long v) { return *this += String(v); }
+  String& operator+=(unsigned long v) { return *this += String(v); }
+  bool concat(const String& o) { s += o.s; return true; }
+  bool concat(char c) { s += c; return true; }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+  friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+  friend String operator+(const String& a, char b) { return String(a.s + b); }
+  friend String operator+(const String& a, int b) { return a + String(b); }
+
+  bool operator==(const String& o) const { return s == o.s; }
+  bool operator==(const char* o) const { return s == o; }
+  bool operator!=(const String& o) const { return s != o.s; }
+  bool operator!=(const char* o) const { return s != o; }
+  bool equals(const String& o) const { return s == o.s; }
+
+  bool startsWith(const String& o) const {
+    return s.compare(0, o.s.size(), o.s) == 0;
+  }
+  bool endsWith(const String& o) const {
+    return s.size() >= o.s.size() &&
+           s.compare(s.size() - o.s.size(), o.s.size(), o.s) == 0;
+  }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(s.find(c, from)); }
+  int indexOf(const String& o, unsigned int from = 0) const { return pos(s.find(o.s, from)); }
+  int lastIndexOf(char c) const { return pos(s.rfind(c)); }
+  int lastIndexOf(char c, unsigned int from) const { return pos(s.rfind(c, from)); }
+  int lastIndexOf(const String& o) const { return pos(s.rfind(o.s)); }
+  int lastIndexOf(const String& o, unsigned int from) const { return pos(s.rfind(o.s, from)); }
+
+  String substring(unsigned int from) const {
+    return from < s.size() ? String(s.substr(from)) : String();
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    return from < s.size() ? String(s.substr(from, to - from)) : String();
+  }
+
+  long  toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+
+  void trim() {
+    size_t a = s.find_first_not_of(" \t\r\n");
+    if (a == Str::npos) { s.clear(); return; }
+    size_t b = s.find_last_not_of(" \t\r\n");
+    s = s.substr(a, b - a + 1);
+  }
+  void replace(char from, char to) { std::replace(s.begin(), s.end(), from, to); }
+  void replace(const String& from, const String& to) {
+    if (from.s.empty()) return;
+    for (size_t p = 0; (p = s.find(from.s, p)) != Str::npos; p += to.s.size()) {
+      s.replace(p, from.s.size(), to.s);
+    }
+  }
+  void remove(unsigned int from) { if (from < s.size()) s.erase(from); }
+  void remove(unsigned int from, unsigned int n) { if (from < s.size()) s.erase(from, n); }
+  void toUpperCase() { for (size_t i = 0; i < s.size(); i++) s[i] = toupper(s[i]); }
+  void toLowerCase() { for (size_t i = 0; i < s.size(); i++) s[i] = tolower(s[i]); }
+  void toCharArray(char* buf, unsigned int n) const {
+    if (!n) return;
+    strncpy(buf, s.c_str(), n - 1);
+    buf[n - 1] = '\0';
+  }
+
+private:
+  String(const Str& c) : s(c) {}
+
+  static int pos(size_t p) { return p == Str::npos ? -1 : (int)p; }
+
+  void fromNumber(unsigned long v, unsigned char base) {
+    char b[34];
+    char* p = b + sizeof(b) - 1;
+    *p = '\0';
+    do { *--p = "0123456789ABCDEF"[v % base]; v /= base; } while (v);
+    s = p;
+  }
+  void fromNumber(long v, unsigned char base) {
+    if (v < 0 && base == 10) {
+      fromNumber((unsigned long)-v, base);
+      s.insert(s.begin(), '-');
+    } else {
+      fromNumber((unsigned long)v, base);
+    }
+  }
+  void fromNumber(int v, unsigned char base) { fromNumber((long)v, base); }
+  void fromNumber(unsigned int v, unsigned char base) { fromNumber((unsigned long)v, base); }
+  void fromNumber(unsigned char v, unsigned char base) { fromNumber((unsigned long)v, base); }
+  void fromFloat(double v, unsigned char digits) {
+    char b[48];
+    snprintf(b, sizeof(b), "%.*f", digits, v);
+    s = b;
+  }
+
+  Str s;
+};
+
+#endif